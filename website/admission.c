@@ -0,0 +1,94 @@
+#include <limits.h>
+#include <stdio.h>
+#include "admission.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+#define SHED_BODY "overloaded, try again shortly\n"
+#define SHED_RETRY_AFTER "1"
+
+// sent as-is, so shedding a request costs no more than parsing it did
+static const char shed_head[] =
+	"HTTP/1.1 503 Service Unavailable\r\n"
+	"Content-Type: text/plain\r\n"
+	"Content-Length: 30\r\n"
+	"Retry-After: " SHED_RETRY_AFTER "\r\n"
+	"Cache-Control: no-store\r\n";
+
+static int max_connections = 0;
+static int max_renders = 0;
+static size_t max_output = 0;
+static char backlog = 0;
+static volatile int connections = 0;
+static volatile int renders = 0;
+static volatile int shed = 0;
+
+void admission_set_connections(int max) {
+	max_connections = max;
+}
+
+void admission_set_renders(int max) {
+	max_renders = max;
+}
+
+void admission_set_output(size_t bytes) {
+	max_output = bytes;
+}
+
+void admission_set_backlog(char b) {
+	backlog = b;
+}
+
+void admission_connected() {
+	atomic_inc(&connections);
+}
+
+void admission_closed() {
+	atomic_dec(&connections);
+}
+
+static int over(size_t output) {
+	return (max_connections && atomic_load_int(&connections) > max_connections)
+		|| (max_output && output > max_output);
+}
+
+// how many more connections the listener should take; connections accepted before the
+// limit was reached are still answered, and the listener resumes once enough have closed
+int admission_room(size_t output) {
+	int open = atomic_load_int(&connections);
+	if (!backlog || !max_connections)
+		return backlog && max_output && output > max_output ? 0 : INT_MAX;
+	if (max_output && output > max_output)
+		return 0;
+	return open < max_connections ? max_connections - open : 0;
+}
+
+int admission_allow(size_t output) {
+	return backlog || !over(output);
+}
+
+int admission_begin_render() {
+	if (atomic_inc(&renders) > max_renders && max_renders) {
+		atomic_dec(&renders);
+		return 0;
+	}
+	return 1;
+}
+
+void admission_end_render() {
+	atomic_dec(&renders);
+}
+
+void admission_shed(sb_Stream* s) {
+	atomic_inc(&shed);
+	sb_send_raw(s, shed_head, sizeof(shed_head) - 1, SHED_BODY, sizeof(SHED_BODY) - 1, NULL, NULL);
+}
+
+int admission_stats(buffer* b, size_t output, int io_queued) {
+	char line[256];
+	sprintf(line, "connections %d max %d\nrenders %d max %d\noutput %zu max %zu\nio-queue %d\nshed %d\naccepting %d\n",
+		atomic_load_int(&connections), max_connections, atomic_load_int(&renders), max_renders,
+		output, max_output, io_queued, atomic_load_int(&shed), admission_room(output) > 0);
+	return buffer_append_str(b, line);
+}
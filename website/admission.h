@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+#include "sandbird/sandbird.h"
+#include "buffer.h"
+
+// admission control for one process: caps on open connections, renders in flight and
+// output queued for sending. a limit of 0 means no limit.
+void admission_set_connections(int max);
+void admission_set_renders(int max);
+void admission_set_output(size_t bytes);
+// leave connections beyond the limit in the kernel's backlog rather than answering 503
+void admission_set_backlog(char backlog);
+
+// bookkeeping for every connection, on any thread
+void admission_connected();
+void admission_closed();
+// how many more connections the listener should take, INT_MAX if there is no limit
+int admission_room(size_t output);
+// returns 0 if a request should be shed because the process is over a limit
+int admission_allow(size_t output);
+// returns 0 if the render limit is reached; otherwise admission_end_render must follow
+int admission_begin_render();
+void admission_end_render();
+// answers with the prebuilt 503
+void admission_shed(sb_Stream* s);
+int admission_stats(buffer* b, size_t output, int io_queued);
@@ -0,0 +1,136 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np, sched_getcpu
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "affinity.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include "tinydir.h"
+#endif
+
+#include "debugalloc.h"
+
+int affinity_parse(const char* list, int* cpus, int max) {
+	int count = 0;
+	const char* p = list;
+	while (*p) {
+		char* end;
+		long first = strtol(p, &end, 10), last;
+		if (end == p || first < 0 || first >= AFFINITY_MAX_CPUS)
+			return 0;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first || last >= AFFINITY_MAX_CPUS)
+				return 0;
+			p = end;
+		}
+		for (long cpu = first; cpu <= last; cpu++) {
+			if (count == max)
+				return 0;
+			cpus[count++] = (int)cpu;
+		}
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 0;
+	}
+	return count;
+}
+
+#if defined(_WIN32)
+
+int affinity_pin(int cpu) {
+	if (cpu >= (int)(sizeof(DWORD_PTR) * 8))
+		return 0;
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+int affinity_cpu() {
+	return (int)GetCurrentProcessorNumber();
+}
+
+int affinity_node(int cpu) {
+	UCHAR node;
+	if (cpu > 255 || !GetNumaProcessorNode((UCHAR)cpu, &node) || node == 0xff)
+		return -1;
+	return node;
+}
+
+int affinity_incoming_cpu(int sockfd) {
+	return -1;
+}
+
+#elif defined(__linux__)
+
+int affinity_pin(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int affinity_cpu() {
+	return sched_getcpu();
+}
+
+// sysfs links each cpu to its node as a "node<n>" entry in the cpu's directory
+int affinity_node(int cpu) {
+	char path[64];
+	tinydir_dir dir;
+	int node = -1;
+	sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+	if (tinydir_open(&dir, path) == -1)
+		return -1;
+	while (dir.has_next && node == -1) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+		if (!strncmp(file.name, "node", 4) && file.name[4] >= '0' && file.name[4] <= '9')
+			node = atoi(file.name + 4);
+		tinydir_next(&dir);
+	}
+	tinydir_close(&dir);
+	return node;
+}
+
+int affinity_incoming_cpu(int sockfd) {
+#ifdef SO_INCOMING_CPU
+	int cpu;
+	socklen_t len = sizeof(cpu);
+	if (!getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len))
+		return cpu;
+#endif
+	return -1;
+}
+
+#else
+
+int affinity_pin(int cpu) {
+	return 0;
+}
+
+int affinity_cpu() {
+	return -1;
+}
+
+int affinity_node(int cpu) {
+	return -1;
+}
+
+int affinity_incoming_cpu(int sockfd) {
+	return -1;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#define AFFINITY_MAX_CPUS 1024
+
+// parses a cpu list like "0-3,8,10-11" into `cpus`; returns how many, 0 if it is malformed
+int affinity_parse(const char* list, int* cpus, int max);
+// pins the calling thread to `cpu`; returns 0 where that is not supported.
+// memory the thread touches first from then on is placed on the cpu's NUMA node.
+int affinity_pin(int cpu);
+// the cpu the calling thread is running on, -1 if unknown
+int affinity_cpu();
+// the NUMA node `cpu` belongs to, -1 if unknown
+int affinity_node(int cpu);
+// the cpu that received the connection's packets (SO_INCOMING_CPU), -1 if unknown
+int affinity_incoming_cpu(int sockfd);
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include "archive.h"
+#include "file.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+static int entry_valid(const archive* a, const archive_entry* e) {
+	return e->path_off <= a->len && a->len - e->path_off >= e->path_len
+		&& e->head_off <= a->len && a->len - e->head_off >= e->head_len
+		&& e->body_off <= a->len && a->len - e->body_off >= e->body_len;
+}
+
+archive* archive_open(const char* path) {
+	const archive_header* header;
+	archive* a = calloc(1, sizeof(*a));
+	if (!a)
+		return NULL;
+	a->base = map_file(path, &a->len);
+	if (!a->base)
+		goto fail;
+	header = (const archive_header*)a->base;
+	if (a->len < sizeof(*header) || memcmp(header->magic, ARCHIVE_MAGIC, 8)
+		|| (a->len - sizeof(*header)) / sizeof(archive_entry) < header->count)
+		goto fail;
+	a->entries = (const archive_entry*)(header + 1);
+	a->count = header->count;
+	for (uint32_t i = 0; i < a->count; i++) {
+		if (!entry_valid(a, &a->entries[i]))
+			goto fail;
+	}
+	a->refs = 1;
+	return a;
+fail:
+	unmap_file(a->base, a->len);
+	free(a);
+	return NULL;
+}
+
+static int compare_path(const char* path, size_t len, const archive* a, const archive_entry* e) {
+	size_t n = len < e->path_len ? len : e->path_len;
+	int cmp = memcmp(path, a->base + e->path_off, n);
+	if (cmp)
+		return cmp;
+	return len < e->path_len ? -1 : len > e->path_len;
+}
+
+const archive_entry* archive_find(const archive* a, const char* path) {
+	size_t len = strlen(path);
+	uint32_t lo = 0, hi = a->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = compare_path(path, len, a, &a->entries[mid]);
+		if (!cmp)
+			return &a->entries[mid];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+// streams sending from the archive hold a reference, so a replaced archive
+// stays mapped until the last of them is done
+void archive_release(archive* a) {
+	if (a && atomic_dec(&a->refs) == 0) {
+		unmap_file(a->base, a->len);
+		free(a);
+	}
+}
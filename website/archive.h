@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// a site archive built by website-pack: header, entries sorted by path, then
+// the paths, prebuilt response heads and bodies they point at. everything is
+// served straight from the mapping.
+#define ARCHIVE_MAGIC "WBPACK01"
+#define ARCHIVE_NOT_FOUND "404" // key of the not found response, never a request path
+
+typedef struct archive_header {
+	char magic[8];
+	uint32_t count;
+	uint32_t reserved;
+} archive_header;
+
+typedef struct archive_entry {
+	uint64_t head_off, head_len; // status line and header fields, each ending in CRLF
+	uint64_t body_off, body_len;
+	uint64_t etag;
+	uint32_t path_off, path_len;
+} archive_entry;
+
+typedef struct archive {
+	const char* base;
+	size_t len;
+	const archive_entry* entries;
+	uint32_t count;
+	volatile int refs;
+} archive;
+
+archive* archive_open(const char* path);
+const archive_entry* archive_find(const archive* a, const char* path);
+void archive_release(archive* a);
@@ -0,0 +1,36 @@
+#include <string.h>
+#include "buffer.h"
+
+#include "debugalloc.h"
+
+int buffer_reserve(buffer* b, size_t n) {
+	size_t cap = b->cap ? b->cap : 256;
+	char* data;
+	if (b->cap >= n)
+		return 1;
+	while (cap < n)
+		cap <<= 1;
+	data = realloc(b->data, cap);
+	if (!data)
+		return 0;
+	b->data = data;
+	b->cap = cap;
+	return 1;
+}
+
+int buffer_append(buffer* b, const void* data, size_t len) {
+	if (!buffer_reserve(b, b->len + len))
+		return 0;
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return 1;
+}
+
+int buffer_append_str(buffer* b, const char* s) {
+	return buffer_append(b, s, strlen(s));
+}
+
+void buffer_free(buffer* b) {
+	free(b->data);
+	memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+
+typedef struct buffer {
+	char* data;
+	size_t len, cap;
+} buffer;
+
+int buffer_reserve(buffer* b, size_t n);
+int buffer_append(buffer* b, const void* data, size_t len);
+int buffer_append_str(buffer* b, const char* s);
+void buffer_free(buffer* b);
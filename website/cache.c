@@ -0,0 +1,598 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "cache.h"
+#include "epoch.h"
+#include "file.h"
+#include "http.h"
+#include "io.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+// entries are never removed, only their pages replaced. `page` and `stale` are read
+// without the lock; everything else is only touched with it held.
+typedef struct entry {
+	char* key;
+	size_t len;
+	uint32_t hash;
+	page* volatile page;
+	volatile int stale;
+	char rendering; // a render for this key is in flight
+	time_t stale_since;
+	time_t gave_up; // mtime of the source the last render only managed a degraded page of
+	time_t gave_up_at; // when that render began
+} entry;
+
+// open addressing over entry pointers. readers find entries without locking: slots only
+// ever go from empty to an entry, and growing publishes a whole new table.
+typedef struct table {
+	size_t cap;
+	entry* volatile* slots;
+} table;
+
+// a page cache_revalidate looks at the source of, without the lock
+typedef struct check {
+	entry* e;
+	page* p;
+	time_t mtime;
+} check;
+
+typedef struct revalidation {
+	entry* e;
+	const char* content_type;
+	page_renderer render;
+	uint32_t templates;
+} revalidation;
+
+// cache file layout: header, records, then the keys and bodies they point at
+#define CACHE_MAGIC "WBCACHE3"
+
+typedef struct cache_header {
+	char magic[8];
+	uint32_t count;
+	uint32_t templates;
+} cache_header;
+
+typedef struct cache_record {
+	int64_t mtime;
+	int64_t rendered;
+	uint64_t etag;
+	uint64_t head_off;
+	uint64_t head_len;
+	uint64_t body_off;
+	uint64_t body_len;
+	uint32_t key_off;
+	uint32_t key_len;
+} cache_record;
+
+static mutex lock;
+static cond_var rendered;
+static table* volatile entries = NULL;
+static size_t entry_count = 0;
+static uint32_t templates = 0;
+static time_t stale_window = 0;
+static size_t seal_threshold = 0; // bodies this large go into sealed memory files, 0 never
+static unsigned changes = 0; // pages published since the last save
+static const void* mapping = NULL;
+static size_t mapping_len = 0;
+
+static void page_put(page* p) {
+	if (p && atomic_dec(&p->refs) == 0) {
+		if (p->fd != -1)
+			unseal_data(p->data, p->len, p->fd);
+		else if (!p->mapped)
+			free(p->data);
+		if (!p->mapped)
+			free(p->head);
+		free(p);
+	}
+}
+
+static void page_retire(void* p) {
+	page_put((page*)p);
+}
+
+static void table_free(void* p) {
+	table* t = (table*)p;
+	if (t) {
+		free((void*)t->slots);
+		free(t);
+	}
+}
+
+static entry* table_find(const table* t, const char* key, size_t len, uint32_t hash) {
+	if (!t)
+		return NULL;
+	for (size_t i = hash & (t->cap - 1);; i = (i + 1) & (t->cap - 1)) {
+		entry* e = (entry*)atomic_load_ptr((void* volatile*)&t->slots[i]);
+		if (!e)
+			return NULL;
+		if (e->hash == hash && e->len == len && !memcmp(e->key, key, len))
+			return e;
+	}
+}
+
+static void table_put(table* t, entry* e) {
+	size_t i = e->hash & (t->cap - 1);
+	while (t->slots[i])
+		i = (i + 1) & (t->cap - 1);
+	atomic_store_ptr((void* volatile*)&t->slots[i], e);
+}
+
+// readers still probing the old table are fine, it is only freed once they are gone; called locked
+static int grow() {
+	table* old = entries;
+	table* t = malloc(sizeof(*t));
+	if (!t)
+		return 0;
+	t->cap = old ? old->cap * 2 : 64;
+	t->slots = calloc(t->cap, sizeof(*t->slots));
+	if (!t->slots) {
+		free(t);
+		return 0;
+	}
+	for (size_t i = 0; old && i < old->cap; i++) {
+		if (old->slots[i])
+			table_put(t, old->slots[i]);
+	}
+	atomic_store_ptr((void* volatile*)&entries, t);
+	if (old)
+		epoch_retire(table_free, old);
+	return 1;
+}
+
+// called locked
+static entry* entry_get(const char* key) {
+	size_t len = strlen(key);
+	uint32_t hash = hash_string(key, len);
+	entry* e = table_find(entries, key, len, hash);
+	if (e)
+		return e;
+	if ((!entries || entry_count + 1 > entries->cap / 4 * 3) && !grow())
+		return NULL;
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+	e->key = malloc(len + 1);
+	if (!e->key) {
+		free(e);
+		return NULL;
+	}
+	memcpy(e->key, key, len + 1);
+	e->len = len;
+	e->hash = hash;
+	table_put(entries, e);
+	entry_count++;
+	return e;
+}
+
+void cache_init() {
+	epoch_init();
+	mutex_init(&lock);
+	cond_init(&rendered);
+}
+
+static page* page_new(char* head, size_t head_len, char* data, size_t len, uint64_t etag, time_t mtime, uint32_t tpl) {
+	page* p = malloc(sizeof(*p));
+	if (!p)
+		return NULL;
+	p->head = head;
+	p->head_len = head_len;
+	p->data = data;
+	p->len = len;
+	p->etag = etag;
+	p->mtime = mtime;
+	p->rendered = 0;
+	p->templates = tpl;
+	p->mapped = 0;
+	p->fd = -1;
+	p->refs = 1; // held by the entry
+	return p;
+}
+
+// sets `gave_up` to the mtime of the source if the renderer only managed a degraded page, else to 0,
+// and `started` to when the render began
+static page* render_page_to_cache(const char* key, const char* content_type, page_renderer render, uint32_t tpl,
+	time_t* gave_up, time_t* started) {
+	buffer out = { 0 }, head = { 0 };
+	time_t mtime = 0;
+	page* p = NULL;
+	int rendered;
+	*started = time(NULL);
+	rendered = render(&out, key, &mtime);
+	*gave_up = rendered < 0 ? mtime : 0;
+	if (rendered) {
+		uint64_t etag = hash_data(out.data, out.len);
+		int fd = -1;
+		char* data = out.data;
+		// sealed bodies are sent with sendfile and shared with forked workers
+		if (seal_threshold && out.len >= seal_threshold)
+			data = (char*)seal_data(key, out.data, out.len, &fd);
+		if (!data)
+			data = out.data;
+		if (http_head(&head, 200, "Hello there", content_type, out.len, etag))
+			p = page_new(head.data, head.len, data, out.len, etag, mtime, tpl);
+		if (p) {
+			p->fd = fd;
+			p->rendered = *started;
+			head.data = NULL;
+			if (fd == -1)
+				out.data = NULL;
+		} else if (fd != -1) {
+			unseal_data(data, out.len, fd);
+		}
+	}
+	buffer_free(&out);
+	buffer_free(&head);
+	return p;
+}
+
+// swaps in the result of a render and wakes everyone waiting for it; called locked.
+// lock-free readers may still be taking a reference to the old page, so it is retired.
+static void publish(entry* e, page* p) {
+	page* old = e->page;
+	// a failed render means the source is gone, so any stale page goes with it
+	atomic_store_ptr((void* volatile*)&e->page, p);
+	atomic_store_int(&e->stale, 0);
+	if (old)
+		epoch_retire(page_retire, old);
+	e->rendering = 0;
+	e->gave_up = 0;
+	changes++;
+	cond_broadcast(&rendered);
+}
+
+// publishes a render, unless it only managed a degraded page and there is a page already:
+// that one is then served on as if fresh, and not revalidated until the source changes
+// again, since another render would only give up again; called locked.
+static void publish_render(entry* e, page* p, time_t gave_up, time_t started) {
+	if (!gave_up || !e->page) {
+		publish(e, p);
+		return;
+	}
+	page_put(p);
+	e->gave_up = gave_up;
+	e->gave_up_at = started;
+	atomic_store_int(&e->stale, 0);
+	e->rendering = 0;
+	cond_broadcast(&rendered);
+}
+
+static void revalidate_main(void* arg) {
+	revalidation* r = (revalidation*)arg;
+	time_t gave_up, started;
+	page* p = render_page_to_cache(r->e->key, r->content_type, r->render, r->templates, &gave_up, &started);
+	mutex_lock(&lock);
+	publish_render(r->e, p, gave_up, started);
+	mutex_unlock(&lock);
+	free(r);
+}
+
+// starts a background render of a stale page on the I/O pool, which finishes all of them
+// before it stops, so none outlives the cache; called locked. without a pool, the
+// caller renders in the foreground.
+static int start_revalidation(entry* e, const char* content_type, page_renderer render) {
+	revalidation* r = malloc(sizeof(*r));
+	if (!r)
+		return 0;
+	r->e = e;
+	r->content_type = content_type;
+	r->render = render;
+	r->templates = templates;
+	e->rendering = 1;
+	if (!io_run(revalidate_main, r)) {
+		e->rendering = 0;
+		free(r);
+		return 0;
+	}
+	return 1;
+}
+
+// serving a stale page is fine while it has not been stale for longer than the window
+static char within_stale_window(const entry* e) {
+	return stale_window && e->page && time(NULL) - e->stale_since <= stale_window;
+}
+
+void cache_set_stale_window(unsigned seconds) {
+	stale_window = seconds;
+}
+
+void cache_set_seal_threshold(size_t bytes) {
+	seal_threshold = bytes;
+}
+
+// single-flight: the first request to find a page missing or stale renders it,
+// every request arriving meanwhile waits for and shares that one result. with a
+// stale window set, stale pages are served while a background render replaces them.
+// fresh pages, the common case, are found without taking the lock at all.
+// unless `block` is set, NULL is returned instead of rendering or waiting.
+static page* get(const char* key, const char* content_type, page_renderer render, char block) {
+	uint32_t tpl;
+	time_t gave_up, started;
+	char waited = 0;
+	entry* e;
+	page* p;
+
+	if (epoch_enter()) {
+		size_t len = strlen(key);
+		e = table_find((table*)atomic_load_ptr((void* volatile*)&entries), key, len, hash_string(key, len));
+		p = e ? (page*)atomic_load_ptr((void* volatile*)&e->page) : NULL;
+		if (p && !atomic_load_int(&e->stale)) {
+			atomic_inc(&p->refs);
+			epoch_exit();
+			return p;
+		}
+		epoch_exit();
+		if (!block && !stale_window)
+			return NULL;
+	}
+
+	mutex_lock(&lock);
+	e = entry_get(key);
+	if (!e) {
+		mutex_unlock(&lock);
+		return NULL;
+	}
+	for (;;) {
+		if (e->page && !e->stale)
+			goto hit;
+		if (e->stale && within_stale_window(e) && (e->rendering || start_revalidation(e, content_type, render)))
+			goto hit;
+		if (!block) {
+			mutex_unlock(&lock);
+			return NULL;
+		}
+		if (!e->rendering) {
+			// a waiter shares the result it waited for, even a failed one
+			if (waited)
+				goto hit;
+			break;
+		}
+		cond_wait(&rendered, &lock);
+		waited = 1;
+	}
+	e->rendering = 1;
+	tpl = templates;
+	mutex_unlock(&lock);
+
+	p = render_page_to_cache(key, content_type, render, tpl, &gave_up, &started);
+
+	mutex_lock(&lock);
+	publish_render(e, p, gave_up, started);
+hit:
+	p = e->page;
+	if (p)
+		atomic_inc(&p->refs);
+	mutex_unlock(&lock);
+	return p;
+}
+
+page* cache_get(const char* key, const char* content_type, page_renderer render) {
+	return get(key, content_type, render, 1);
+}
+
+page* cache_try_get(const char* key, const char* content_type, page_renderer render) {
+	return get(key, content_type, render, 0);
+}
+
+// takes a void* so it can be handed to sb_send_raw as the release callback
+void cache_release(void* p) {
+	page_put((page*)p);
+}
+
+// marks pages whose source or templates changed since they were rendered. the sources are
+// looked at without the lock: entries are never removed and their keys never change, and
+// a page is only marked if it is still the one there once the lock is taken again.
+void cache_revalidate(page_source source, uint32_t tpl) {
+	time_t now = time(NULL);
+	check* checks;
+	size_t count = 0;
+	mutex_lock(&lock);
+	templates = tpl;
+	checks = malloc((entry_count + 1) * sizeof(*checks));
+	for (size_t i = 0; checks && entries && i < entries->cap; i++) {
+		entry* e = entries->slots[i];
+		if (!e || !e->page || e->stale || e->rendering)
+			continue;
+		checks[count].e = e;
+		checks[count++].p = e->page;
+	}
+	mutex_unlock(&lock);
+	if (!checks)
+		return;
+
+	for (size_t i = 0; i < count; i++)
+		checks[i].mtime = source(checks[i].e->key);
+
+	mutex_lock(&lock);
+	for (size_t i = 0; i < count; i++) {
+		entry* e = checks[i].e;
+		time_t mtime = checks[i].mtime;
+		if (e->page != checks[i].p || e->stale || e->rendering)
+			continue;
+		// a kept page is only left be while it has the current templates
+		if (e->gave_up && e->page->templates == tpl && source_unchanged(mtime, e->gave_up, e->gave_up_at, now))
+			continue;
+		if (e->page->templates != tpl || !source_unchanged(mtime, e->page->mtime, e->page->rendered, now)) {
+			e->stale_since = now;
+			atomic_store_int(&e->stale, 1);
+		}
+	}
+	mutex_unlock(&lock);
+	free(checks);
+	epoch_collect();
+}
+
+// writes every fresh page to `path`, through a temporary file so a crash never leaves a torn cache behind
+int cache_save(const char* path) {
+	cache_header header;
+	entry** saved;
+	page** pages;
+	size_t count = 0;
+	uint64_t off;
+	char* tmp;
+	FILE* fp;
+	int ok = 1;
+
+	mutex_lock(&lock);
+	if (!changes) {
+		mutex_unlock(&lock);
+		return 1;
+	}
+	saved = malloc((entry_count + 1) * sizeof(*saved));
+	pages = malloc((entry_count + 1) * sizeof(*pages));
+	if (!saved || !pages) {
+		mutex_unlock(&lock);
+		free(saved);
+		free(pages);
+		return 0;
+	}
+	for (size_t i = 0; entries && i < entries->cap; i++) {
+		entry* e = entries->slots[i];
+		if (e && e->page && !e->stale && e->page->templates == templates) {
+			atomic_inc(&e->page->refs);
+			saved[count] = e;
+			pages[count++] = e->page;
+		}
+	}
+	memcpy(header.magic, CACHE_MAGIC, 8);
+	header.count = (uint32_t)count;
+	header.templates = templates;
+	changes = 0;
+	mutex_unlock(&lock);
+
+	// entries are never removed, and the pages as they were are kept alive by the references taken above
+	tmp = malloc(strlen(path) + 5);
+	fp = NULL;
+	if (tmp) {
+		sprintf(tmp, "%s.tmp", path);
+		fp = fopen(tmp, "wb");
+	}
+	ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1;
+	off = sizeof(header) + count * sizeof(cache_record);
+	for (size_t i = 0; ok && i < count; i++) {
+		cache_record rec;
+		page* p = pages[i];
+		memset(&rec, 0, sizeof(rec));
+		rec.mtime = p->mtime;
+		rec.rendered = p->rendered;
+		rec.etag = p->etag;
+		rec.key_len = (uint32_t)strlen(saved[i]->key);
+		rec.key_off = (uint32_t)off;
+		rec.head_off = off + rec.key_len;
+		rec.head_len = p->head_len;
+		rec.body_off = rec.head_off + rec.head_len;
+		rec.body_len = p->len;
+		off = rec.body_off + rec.body_len;
+		ok = fwrite(&rec, sizeof(rec), 1, fp) == 1;
+	}
+	for (size_t i = 0; ok && i < count; i++) {
+		page* p = pages[i];
+		ok = fwrite(saved[i]->key, 1, strlen(saved[i]->key), fp) == strlen(saved[i]->key)
+			&& fwrite(p->head, 1, p->head_len, fp) == p->head_len
+			&& fwrite(p->data, 1, p->len, fp) == p->len;
+	}
+	if (fp && fclose(fp))
+		ok = 0;
+	if (ok) {
+#ifdef _WIN32
+		remove(path);
+#endif
+		ok = !rename(tmp, path);
+	}
+	if (!ok && tmp)
+		remove(tmp);
+	free(tmp);
+
+	for (size_t i = 0; i < count; i++)
+		page_put(pages[i]);
+	if (!ok) {
+		mutex_lock(&lock);
+		changes++;
+		mutex_unlock(&lock);
+	}
+	free(saved);
+	free(pages);
+	return ok;
+}
+
+// maps a cache file written by cache_save and adopts every page whose source and templates
+// are unchanged. their heads and bodies are served straight from the mapping.
+int cache_load(const char* path, page_source source) {
+	const cache_header* header;
+	const cache_record* recs;
+	const char* base;
+	size_t len;
+	time_t now = time(NULL);
+	int loaded = 0;
+
+	if (mapping)
+		return 0;
+	base = map_file(path, &len);
+	if (!base)
+		return 0;
+	header = (const cache_header*)base;
+	recs = (const cache_record*)(header + 1);
+	if (len < sizeof(*header) || memcmp(header->magic, CACHE_MAGIC, 8)
+		|| (len - sizeof(*header)) / sizeof(*recs) < header->count) {
+		unmap_file(base, len);
+		return 0;
+	}
+
+	mutex_lock(&lock);
+	if (header->templates != templates) {
+		mutex_unlock(&lock);
+		unmap_file(base, len);
+		return 0;
+	}
+	for (uint32_t i = 0; i < header->count; i++) {
+		const cache_record* rec = &recs[i];
+		char key[1024];
+		entry* e;
+		page* p;
+		if (rec->key_len >= sizeof(key) || rec->key_off > len || len - rec->key_off < rec->key_len
+			|| rec->head_off > len || len - rec->head_off < rec->head_len
+			|| rec->body_off > len || len - rec->body_off < rec->body_len)
+			continue;
+		memcpy(key, base + rec->key_off, rec->key_len);
+		key[rec->key_len] = '\0';
+		if (!source_unchanged(source(key), (time_t)rec->mtime, (time_t)rec->rendered, now))
+			continue;
+		e = entry_get(key);
+		if (!e || e->page)
+			continue;
+		p = page_new((char*)base + rec->head_off, (size_t)rec->head_len, (char*)base + rec->body_off,
+			(size_t)rec->body_len, rec->etag, (time_t)rec->mtime, templates);
+		if (!p)
+			continue;
+		p->mapped = 1;
+		p->rendered = (time_t)rec->rendered;
+		atomic_store_ptr((void* volatile*)&e->page, p);
+		loaded++;
+	}
+	mapping = base;
+	mapping_len = len;
+	mutex_unlock(&lock);
+	return loaded;
+}
+
+void cache_free() {
+	table* t = entries;
+	for (size_t i = 0; t && i < t->cap; i++) {
+		entry* e = t->slots[i];
+		if (e) {
+			page_put(e->page);
+			free(e->key);
+			free(e);
+		}
+	}
+	table_free(t);
+	entries = NULL;
+	entry_count = 0;
+	// retired pages may point into the mapping, so they go first
+	epoch_free();
+	unmap_file(mapping, mapping_len);
+	mapping = NULL;
+	cond_destroy(&rendered);
+	mutex_destroy(&lock);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "buffer.h"
+
+// rendered pages, keyed by request path. a page is immutable once published and
+// stays alive until its last reference is released, even after being replaced.
+// `head` holds the prebuilt response head so a hit is sent without formatting anything.
+typedef struct page {
+	char* head;
+	size_t head_len;
+	char* data;
+	size_t len;
+	uint64_t etag;       // hash of data
+	time_t mtime;        // mtime of the source when it was rendered
+	time_t rendered;     // when the render began
+	uint32_t templates;  // hash of the templates it was rendered with
+	char mapped;         // head and data point into the loaded cache file
+	int fd;              // sealed memory file holding data, which then maps it; -1 if none
+	volatile int refs;
+} page;
+
+// renders `key` into `out`, storing the mtime of its source; returns 0 if there is no such page,
+// and -1 if it only managed a degraded one, say because the source was too costly to parse
+typedef int (*page_renderer)(buffer* out, const char* key, time_t* mtime);
+typedef time_t (*page_source)(const char* key);
+
+void cache_init();
+void cache_set_stale_window(unsigned seconds);
+void cache_set_seal_threshold(size_t bytes);
+page* cache_get(const char* key, const char* content_type, page_renderer render);
+// like cache_get, but returns NULL rather than rendering or waiting for a render
+page* cache_try_get(const char* key, const char* content_type, page_renderer render);
+void cache_release(void* p);
+void cache_revalidate(page_source source, uint32_t templates);
+int cache_save(const char* path);
+int cache_load(const char* path, page_source source);
+void cache_free();
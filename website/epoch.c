@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include "epoch.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+// every reading thread owns a record for good. `state` is 0 outside a read section,
+// otherwise the global epoch it entered at shifted up by one with the low bit set.
+typedef struct reader reader;
+struct reader {
+	volatile int state;
+	reader* next;
+};
+
+typedef struct retired retired;
+struct retired {
+	retire_fn fn;
+	void* p;
+	unsigned epoch;
+	retired* next;
+};
+
+static mutex lock; // guards the retired list, registration and advancing the epoch
+static volatile int global_epoch = 0;
+static reader* volatile readers = NULL;
+static retired* limbo = NULL;
+static THREAD_LOCAL reader* self = NULL;
+
+void epoch_init() {
+	mutex_init(&lock);
+}
+
+static reader* register_reader() {
+	reader* r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	mutex_lock(&lock);
+	r->next = readers;
+	atomic_store_ptr((void* volatile*)&readers, r);
+	mutex_unlock(&lock);
+	self = r;
+	return r;
+}
+
+int epoch_enter() {
+	reader* r = self ? self : register_reader();
+	if (!r)
+		return 0;
+	atomic_store_int(&r->state, (int)(((unsigned)atomic_load_int(&global_epoch) << 1) | 1));
+	// pairs with the fence in advance(): either the writer sees this reader, or this
+	// reader sees everything unlinked before the epoch moved on
+	atomic_fence();
+	return 1;
+}
+
+void epoch_exit() {
+	atomic_store_int(&self->state, 0);
+}
+
+void epoch_retire(retire_fn fn, void* p) {
+	retired* r = malloc(sizeof(*r));
+	if (!r) {
+		// nothing to defer with, so wait for every reader to move on instead
+		mutex_lock(&lock);
+		for (reader* rd = readers; rd; rd = rd->next) {
+			while (atomic_load_int(&rd->state))
+				;
+		}
+		mutex_unlock(&lock);
+		fn(p);
+		return;
+	}
+	r->fn = fn;
+	r->p = p;
+	mutex_lock(&lock);
+	r->epoch = (unsigned)global_epoch;
+	r->next = limbo;
+	limbo = r;
+	mutex_unlock(&lock);
+}
+
+// moves the epoch on if every reader inside a read section has seen the current one; called locked
+static unsigned advance() {
+	unsigned epoch = (unsigned)global_epoch;
+	atomic_fence();
+	for (reader* r = readers; r; r = r->next) {
+		unsigned state = (unsigned)atomic_load_int(&r->state);
+		if ((state & 1) && (state >> 1) != (epoch & (~0u >> 1)))
+			return epoch;
+	}
+	atomic_store_int(&global_epoch, (int)(epoch + 1));
+	return epoch + 1;
+}
+
+void epoch_collect() {
+	retired* ready = NULL;
+	retired** link;
+	unsigned epoch;
+	mutex_lock(&lock);
+	epoch = advance();
+	// anything retired two epochs ago was unlinked before every current reader entered
+	for (link = &limbo; *link;) {
+		retired* r = *link;
+		if (epoch - r->epoch >= 2) {
+			*link = r->next;
+			r->next = ready;
+			ready = r;
+		} else {
+			link = &r->next;
+		}
+	}
+	mutex_unlock(&lock);
+	while (ready) {
+		retired* next = ready->next;
+		ready->fn(ready->p);
+		free(ready);
+		ready = next;
+	}
+}
+
+void epoch_free() {
+	while (limbo) {
+		retired* next = limbo->next;
+		limbo->fn(limbo->p);
+		free(limbo);
+		limbo = next;
+	}
+	while (readers) {
+		reader* next = readers->next;
+		free(readers);
+		readers = next;
+	}
+	self = NULL;
+	mutex_destroy(&lock);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// epoch based reclamation. readers bracket lock-free accesses with epoch_enter and
+// epoch_exit; memory that writers unlink goes to epoch_retire and is only released
+// once no reader that could still see it is left.
+typedef void (*retire_fn)(void* p);
+
+void epoch_init();
+// returns 0 if this thread could not be registered, in which case the caller must lock instead
+int epoch_enter();
+void epoch_exit();
+void epoch_retire(retire_fn fn, void* p);
+// releases whatever no reader can see anymore; called by writers now and then
+void epoch_collect();
+// releases everything retired, once no reader is left
+void epoch_free();
@@ -1,5 +1,19 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // memfd_create
+#endif
 #include "file.h"
 #include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "debugalloc.h"
 
@@ -44,4 +58,126 @@ char* title_from_markdown(const char* file) {
 	while (*p == '#' || *p == ' ') p++;
 	while (p[len] != '\n' && p[len] != '\0') len++;
 	return _strndup(p, len);
-}
\ No newline at end of file
+}
+
+uint32_t hash_string(const char* s, size_t len) {
+	uint32_t h = 2166136261u;
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+uint64_t hash_data(const void* data, size_t len) {
+	const unsigned char* p = data;
+	uint64_t h = 14695981039346656037ull;
+	while (len--) {
+		h ^= *p++;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// 0 when the file does not exist
+time_t file_mtime(const char* path) {
+	struct stat st;
+	if (stat(path, &st))
+		return 0;
+	return st.st_mtime;
+}
+
+// whether a source whose mtime was `was` when it was read at `read_at` still is as it was.
+// mtimes are whole seconds, so an edit in the second it was read looks like no change;
+// such a read counts as outdated once that second is over.
+char source_unchanged(time_t mtime, time_t was, time_t read_at, time_t now) {
+	return mtime == was && (mtime < read_at || now <= mtime);
+}
+
+// maps a whole file read-only; NULL if it is missing or empty
+const void* map_file(const char* path, size_t* len) {
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+	const void* data = NULL;
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+	*len = data ? (size_t)size.QuadPart : 0;
+	return data;
+#else
+	struct stat st;
+	void* data = NULL;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	if (!fstat(fd, &st) && st.st_size > 0) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+	}
+	close(fd);
+	*len = data ? (size_t)st.st_size : 0;
+	return data;
+#endif
+}
+
+void unmap_file(const void* data, size_t len) {
+	if (!data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, len);
+#endif
+}
+
+// copies `data` into an anonymous memory file sealed against any further change and maps
+// it read-only. the file can be handed to sendfile and is shared with forked processes.
+// returns NULL where sealed memory files are not available.
+const void* seal_data(const char* name, const void* data, size_t len, int* fd) {
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	size_t off = 0;
+	void* map;
+	int f;
+	if (!len)
+		return NULL;
+	f = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (f == -1)
+		return NULL;
+	while (off < len) {
+		ssize_t n = write(f, (const char*)data + off, len - off);
+		if (n <= 0)
+			goto fail;
+		off += n;
+	}
+	if (fcntl(f, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+		goto fail;
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, f, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	*fd = f;
+	return map;
+fail:
+	close(f);
+	return NULL;
+#else
+	return NULL;
+#endif
+}
+
+void unseal_data(const void* data, size_t len, int fd) {
+	unmap_file(data, len);
+#ifndef _WIN32
+	if (fd != -1)
+		close(fd);
+#endif
+}
@@ -1,6 +1,16 @@
 #pragma once
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 char valid_file(const char* path, const char* extension);
 char* read_file(const char* path);
-char* title_from_markdown(const char* file);
\ No newline at end of file
+char* title_from_markdown(const char* file);
+uint32_t hash_string(const char* s, size_t len);
+uint64_t hash_data(const void* data, size_t len);
+time_t file_mtime(const char* path);
+char source_unchanged(time_t mtime, time_t was, time_t read_at, time_t now);
+const void* map_file(const char* path, size_t* len);
+void unmap_file(const void* data, size_t len);
+const void* seal_data(const char* name, const void* data, size_t len, int* fd);
+void unseal_data(const void* data, size_t len, int fd);
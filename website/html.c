@@ -2,68 +2,192 @@
 #include "html.h"
 #include "file.h"
 #include "md4c/render_html.h"
+#include "thread.h"
 #include "tinydir.h"
 
 #include "debugalloc.h"
 
-char* prologue() {
-	char* ret = read_file("data/prologue.t");
-	if (!ret)
-		return "<h1>no prologue</h1>";
-	return ret;
+#define BLOG_DIR "./blog/"
+
+typedef struct html_output {
+	buffer* b;
+	int ok;
+} html_output;
+
+typedef struct markdown_page {
+	const char* file;
+	char degraded; // the parse went over budget, so the page shows the source as is
+} markdown_page;
+
+static THREAD_LOCAL MD_PARSER_CTX* parser = NULL;
+static THREAD_LOCAL MD_ARENA* arena = NULL;   // the rest of what a page needs, reset after each
+static unsigned parse_budget = 0;
+
+void html_set_parse_budget(unsigned budget) {
+	parse_budget = budget;
+}
+
+// without a context or an arena, rendering still works, just allocating as it goes
+void html_thread_start() {
+	if (!parser)
+		parser = md_parser_ctx_new(0);
+	if (!arena)
+		arena = md_arena_new(0);
 }
 
-char* epilogue() {
-	char* ret = read_file("data/epilogue.t");
-	if (!ret)
-		return "<h1>no epilogue</h1>";
-	return ret;
+void html_thread_stop() {
+	md_parser_ctx_free(parser);
+	parser = NULL;
+	md_arena_free(arena);
+	arena = NULL;
 }
 
-static void process_html(const MD_CHAR* text, MD_SIZE size, void* userdata) { sb_write((sb_Stream*)userdata, text, size); }
-void render_page(sb_Stream* s, const char* path) {
+// expands "%s" to the title and "%%" to "%", as sb_writef does for the templates
+static int append_template(buffer* b, const char* tpl, const char* title) {
+	const char* p = tpl;
+	while (*p) {
+		const char* pct = strchr(p, '%');
+		if (!pct)
+			return buffer_append_str(b, p);
+		if (!buffer_append(b, p, pct - p))
+			return 0;
+		if (pct[1] == 's') {
+			if (!buffer_append_str(b, title))
+				return 0;
+			p = pct + 2;
+		} else if (pct[1] == '%') {
+			if (!buffer_append(b, "%", 1))
+				return 0;
+			p = pct + 2;
+		} else {
+			if (!buffer_append(b, "%", 1))
+				return 0;
+			p = pct + 1;
+		}
+	}
+	return 1;
+}
+
+// writes the prologue with `title`, then `body`, then the epilogue
+static int render_with_templates(buffer* b, const char* title, int (*body)(buffer*, void*), void* udata) {
+	char* pro = read_file("data/prologue.t");
+	char* epi = read_file("data/epilogue.t");
+	int ok = append_template(b, pro ? pro : "<h1>no prologue</h1>", title)
+		&& body(b, udata)
+		&& append_template(b, epi ? epi : "<h1>no epilogue</h1>", "");
+	free(pro);
+	free(epi);
+	return ok;
+}
+
+static void process_html(const MD_CHAR* text, MD_SIZE size, void* userdata) {
+	html_output* out = (html_output*)userdata;
+	out->ok = out->ok && buffer_append(out->b, text, size);
+}
+
+// the fallback for a post too costly to parse: its source, escaped, in a <pre>
+static int source_body(buffer* b, const char* file) {
+	const char* p = file;
+	int ok = buffer_append_str(b, "<pre>");
+	while (ok && *p) {
+		size_t n = strcspn(p, "&<>");
+		ok = buffer_append(b, p, n);
+		p += n;
+		if (ok && *p) {
+			ok = buffer_append_str(b, *p == '&' ? "&amp;" : *p == '<' ? "&lt;" : "&gt;");
+			p++;
+		}
+	}
+	return ok && buffer_append_str(b, "</pre>");
+}
+
+static int markdown_body(buffer* b, void* udata) {
+	markdown_page* page = (markdown_page*)udata;
+	html_output out = { b, 1 };
+	size_t start = b->len;
+	int ret = md_render_html_ctx(parser, arena ? md_arena_allocator(arena) : NULL, parse_budget,
+		page->file, strlen(page->file), process_html, &out,
+		MD_DIALECT_GITHUB | MD_FLAG_LATEXMATHSPANS | MD_FLAG_WIKILINKS, 0);
+	if (arena)
+		md_arena_reset(arena);
+	if (ret == MD_BUDGET_EXCEEDED && out.ok) {
+		b->len = start;
+		page->degraded = 1;
+		return source_body(b, page->file);
+	}
+	// anything else non-zero, running out of memory say, left the page cut short
+	return !ret && out.ok;
+}
+
+static char* blog_path(const char* path) {
 	char* blogpath = malloc(strlen(path) + 10);
+	if (blogpath)
+		sprintf(blogpath, BLOG_DIR "%s", path + 1);
+	return blogpath;
+}
+
+int render_page(buffer* b, const char* path, time_t* mtime) {
+	char* blogpath = blog_path(path);
+	char* file;
+	int ok = 0;
 	if (!blogpath)
-		return;
-	sprintf(blogpath, "./blog/%s", path + 1);
-	char* file = read_file(blogpath);
-	char* pro = prologue();
-	char* epi = epilogue();
+		return 0;
+	*mtime = file_mtime(blogpath);
+	file = read_file(blogpath);
 	if (file) {
 		char* title = title_from_markdown(file);
-		sb_writef(s, pro, title);
+		markdown_page page = { file, 0 };
+		ok = title && render_with_templates(b, title, markdown_body, &page);
+		if (ok && page.degraded)
+			ok = -1;
 		free(title);
-
-		md_render_html(file, strlen(file), process_html, s, MD_DIALECT_GITHUB | MD_FLAG_LATEXMATHSPANS | MD_FLAG_WIKILINKS, 0);
 		free(file);
-	} else {
-		sb_writef(s, pro, "404 not found");
-		sb_writef(s, "<h1>404. how did we get here?</h1>");
 	}
-	sb_writef(s, epi);
 	free(blogpath);
-	free(pro);
-	free(epi);
+	return ok;
+}
+
+static int not_found_body(buffer* b, void* udata) {
+	return buffer_append_str(b, "<h1>404. how did we get here?</h1>");
+}
+
+int render_not_found(buffer* b) {
+	return render_with_templates(b, "404 not found", not_found_body, NULL);
 }
-void render_index(sb_Stream* s) {
-	char* pro = prologue();
-	char* epi = epilogue();
-	sb_writef(s, pro, "index");
-	sb_writef(s, "<ul>");
+
+static int index_body(buffer* b, void* udata) {
 	tinydir_dir dir;
-	tinydir_open(&dir, "./blog/");
-	while (dir.has_next) {
+	int ok = buffer_append_str(b, "<ul>");
+	tinydir_open(&dir, BLOG_DIR);
+	while (ok && dir.has_next) {
 		tinydir_file file;
 		tinydir_readfile(&dir, &file);
 		if (!file.is_dir && strcmp(file.name, "about.md")) {
-			sb_writef(s, "<li> <a href=\"/%s\">%s</a></li>", file.name, file.name);
+			ok = buffer_append_str(b, "<li> <a href=\"/") && buffer_append_str(b, file.name)
+				&& buffer_append_str(b, "\">") && buffer_append_str(b, file.name)
+				&& buffer_append_str(b, "</a></li>");
 		}
 		tinydir_next(&dir);
 	}
 	tinydir_close(&dir);
+	return ok && buffer_append_str(b, "</ul>");
+}
 
-	sb_writef(s, "</ul>");
-	sb_writef(s, epi);
-	free(pro);
-	free(epi);
-}
\ No newline at end of file
+int render_index(buffer* b, const char* path, time_t* mtime) {
+	*mtime = file_mtime(BLOG_DIR);
+	return render_with_templates(b, "index", index_body, NULL);
+}
+
+// the mtime a cached page was rendered from: the post itself, or the blog directory for the index
+time_t page_mtime(const char* path) {
+	char* blogpath;
+	time_t mtime;
+	if (!strcmp(path, "/"))
+		return file_mtime(BLOG_DIR);
+	blogpath = blog_path(path);
+	if (!blogpath)
+		return 0;
+	mtime = file_mtime(blogpath);
+	free(blogpath);
+	return mtime;
+}
@@ -1,7 +1,19 @@
 #pragma once
-#include "sandbird/sandbird.h"
+#include <time.h>
+#include "buffer.h"
 
-char* prologue();
-char* epilogue();
-void render_page(sb_Stream* s, const char* path);
-void render_index(sb_Stream* s);
\ No newline at end of file
+// page renderers, see page_renderer in cache.h
+int render_page(buffer* b, const char* path, time_t* mtime);
+int render_index(buffer* b, const char* path, time_t* mtime);
+int render_not_found(buffer* b);
+time_t page_mtime(const char* path);
+// caps the work of parsing a post, in units of about a byte of markdown (see
+// MD_PARSER::budget); a post going over it is rendered as its plain source instead,
+// and render_page returns -1. 0, the default, means no cap.
+void html_set_parse_budget(unsigned budget);
+
+// a thread rendering page after page brackets its work with these, so that the markdown
+// parser keeps its working memory from one page to the next and carves the rest out of
+// an arena. other threads parse with fresh memory each time.
+void html_thread_start();
+void html_thread_stop();
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include "http.h"
+#include "file.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+int http_head(buffer* b, int code, const char* msg, const char* content_type, size_t len, uint64_t etag) {
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"HTTP/1.1 %d %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %llu\r\n"
+		"ETag: \"%016llx\"\r\n"
+		"%s",
+		code, msg, content_type, (unsigned long long)len, (unsigned long long)etag,
+		code == 200 ? "Cache-Control: " HTTP_CACHE_CONTROL "\r\n" : "");
+	if (n < 0 || (size_t)n >= sizeof(line))
+		return 0;
+	return buffer_append(b, line, n);
+}
+
+response* response_new(int code, const char* msg, const char* content_type, const char* body, size_t len) {
+	buffer b = { 0 };
+	response* r = malloc(sizeof(*r));
+	if (!r)
+		return NULL;
+	if (!http_head(&b, code, msg, content_type, len, hash_data(body, len)) || !buffer_append(&b, body, len)) {
+		buffer_free(&b);
+		free(r);
+		return NULL;
+	}
+	r->data = b.data;
+	r->len = b.len;
+	r->head_len = b.len - len;
+	r->refs = 1;
+	return r;
+}
+
+void response_release(void* r) {
+	response* res = (response*)r;
+	if (res && atomic_dec(&res->refs) == 0) {
+		free(res->data);
+		free(res);
+	}
+}
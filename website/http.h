@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "buffer.h"
+
+#define HTTP_CACHE_CONTROL "public, max-age=60"
+
+// appends a prebuilt response head: status line, Content-Type, Content-Length,
+// ETag and, for 200s, Cache-Control, each ending in CRLF. the per-request Date
+// and Connection lines and the blank line are added by sb_send_raw.
+int http_head(buffer* b, int code, const char* msg, const char* content_type, size_t len, uint64_t etag);
+
+// a complete serialized response, head followed by body in one allocation.
+// it stays alive until the last stream sending it is done, even after being replaced.
+typedef struct response {
+	char* data;
+	size_t head_len;
+	size_t len;
+	volatile int refs;
+} response;
+
+response* response_new(int code, const char* msg, const char* content_type, const char* body, size_t len);
+// takes a void* so it can be handed to sb_send_raw as the release callback
+void response_release(void* r);
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include "io.h"
+#include "html.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+typedef struct io_job io_job;
+struct io_job {
+	sb_Stream* s;
+	io_work work;
+	io_done done;
+	void* udata;
+	io_job* next;
+};
+
+static mutex lock;
+static cond_var changed;
+static io_job* head = NULL;
+static io_job* tail = NULL;
+static int active = 0;
+static int queued = 0;
+static char stopping = 0;
+
+// queued work is always finished, even while stopping, so every deferred stream gets resumed
+static void io_main(void* arg) {
+	html_thread_start();
+	mutex_lock(&lock);
+	for (;;) {
+		io_job* j;
+		while (!head && !stopping)
+			cond_wait(&changed, &lock);
+		if (!head)
+			break;
+		j = head;
+		head = j->next;
+		if (!head)
+			tail = NULL;
+		queued--;
+		mutex_unlock(&lock);
+		j->work(j->udata);
+		if (j->s)
+			sb_resume(j->s, j->done, j->udata);
+		free(j);
+		mutex_lock(&lock);
+	}
+	html_thread_stop();
+	active--;
+	cond_broadcast(&changed);
+	mutex_unlock(&lock);
+}
+
+int io_start(int threads) {
+	mutex_init(&lock);
+	cond_init(&changed);
+	for (int i = 0; i < threads; i++) {
+		mutex_lock(&lock);
+		active++;
+		mutex_unlock(&lock);
+		if (!thread_spawn(io_main, NULL)) {
+			mutex_lock(&lock);
+			active--;
+			mutex_unlock(&lock);
+			break;
+		}
+	}
+	return active > 0;
+}
+
+static int queue(sb_Stream* s, io_work work, io_done done, void* udata) {
+	io_job* j = malloc(sizeof(*j));
+	if (!j)
+		return 0;
+	j->s = s;
+	j->work = work;
+	j->done = done;
+	j->udata = udata;
+	j->next = NULL;
+	mutex_lock(&lock);
+	// loops still running while the pool stops do their work themselves
+	if (!active || stopping || (s && sb_defer(s))) {
+		mutex_unlock(&lock);
+		free(j);
+		return 0;
+	}
+	if (tail)
+		tail->next = j;
+	else
+		head = j;
+	tail = j;
+	queued++;
+	cond_broadcast(&changed);
+	mutex_unlock(&lock);
+	return 1;
+}
+
+int io_defer(sb_Stream* s, io_work work, io_done done, void* udata) {
+	return queue(s, work, done, udata);
+}
+
+int io_run(io_work work, void* udata) {
+	return queue(NULL, work, NULL, udata);
+}
+
+int io_queued() {
+	int n;
+	mutex_lock(&lock);
+	n = queued;
+	mutex_unlock(&lock);
+	return n;
+}
+
+void io_stop() {
+	mutex_lock(&lock);
+	stopping = 1;
+	cond_broadcast(&changed);
+	while (active)
+		cond_wait(&changed, &lock);
+	mutex_unlock(&lock);
+}
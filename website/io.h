@@ -0,0 +1,19 @@
+#pragma once
+#include "sandbird/sandbird.h"
+
+// a small pool of threads for work that may block on the disk. a request defers its
+// stream to the pool, and the response is sent from the stream's own loop once the
+// work is done, so a slow read never holds up unrelated connections.
+typedef void (*io_work)(void* udata);             // runs on a pool thread
+typedef void (*io_done)(sb_Stream* s, void* udata); // runs on the stream's loop, sends the response
+
+// call once per process, before any loop defers to the pool
+int io_start(int threads);
+// returns 0 if the stream could not be deferred, leaving the work to the caller
+int io_defer(sb_Stream* s, io_work work, io_done done, void* udata);
+// queues work no response waits for; returns 0 if the pool is not running
+int io_run(io_work work, void* udata);
+// work waiting for a pool thread
+int io_queued();
+// waits for queued work to finish; streams deferred from then on are refused
+void io_stop();
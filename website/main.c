@@ -2,60 +2,556 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <locale.h>
+#include <signal.h>
 
 #include "sandbird/sandbird.h"
 #include "tinydir.h"
 
+#include "admission.h"
+#include "affinity.h"
+#include "archive.h"
+#include "cache.h"
+#include "epoch.h"
 #include "file.h"
 #include "html.h"
+#include "io.h"
+#include "posts.h"
+#include "prefork.h"
+#include "ratelimit.h"
+#include "route.h"
+#include "shared.h"
+#include "thread.h"
+#include "worker.h"
 
 #ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
 #pragma comment(lib, "ws2_32.lib")
+#else
+#include <unistd.h>
 #endif
 
+#define CACHE_SAVE_INTERVAL 60
+#define SHARED_CACHE_MB 64
+#define IO_THREADS 4
+#define STATS_PATH "/_stats"
+
+static const char* cache_file = NULL;
+static time_t last_save = 0;
+static const char* archive_file = NULL;
+static archive* volatile site = NULL;
+static time_t site_mtime = 0;
+static int workers = 0;
+static int threads = 0;
+static int io_threads = IO_THREADS;
+static worker_policy policy = WORKER_LEAST_LOADED;
+static int cpus[AFFINITY_MAX_CPUS];
+static int cpu_count = 0;
+static int pinned = -1; // cpu this process serves from when it has no worker threads
+static sb_Options opt;
+static sb_Server* server = NULL;
+static uint32_t templates = 0;
+static volatile sig_atomic_t running = 1;
+static volatile int refreshing = 0;
+
+// a page found in the shared cache, or else in this process's own one
+typedef struct found_page {
+	shared_page sp;
+	page* p;
+} found_page;
+
+// a cache miss, rendered on the I/O pool
+typedef struct page_job {
+	const route* r;
+	page_renderer render;
+	found_page f;
+	int ok;
+	char key[];
+} page_job;
+
+static size_t output_pending() {
+	return sb_pending(server) + worker_pending();
+}
+
+// without `block`, only pages that are ready to send are found
+static int find_page(const char* key, const route* r, page_renderer render, found_page* f, char block) {
+	int found = block ? shared_get(key, r->content_type, render, &f->sp) : shared_try_get(key, &f->sp);
+	f->p = NULL;
+	// a failed shared render is not tried again here
+	if (found)
+		return found > 0;
+	f->p = block ? cache_get(key, r->content_type, render) : cache_try_get(key, r->content_type, render);
+	return f->p != NULL;
+}
+
+// hits are sent as the page's prebuilt head and body, without copying either.
+// sealed bodies go out with sendfile, straight from the memory file.
+static void send_found(sb_Stream* s, found_page* f) {
+	page* p = f->p;
+	int err;
+	if (!p) {
+		if (sb_send_raw(s, f->sp.head, f->sp.head_len, f->sp.data, f->sp.len, shared_release, f->sp.pin))
+			shared_release(f->sp.pin);
+		return;
+	}
+	if (p->fd != -1)
+		err = sb_send_raw_fd(s, p->head, p->head_len, p->fd, 0, p->len, cache_release, p);
+	else
+		err = sb_send_raw(s, p->head, p->head_len, p->data, p->len, cache_release, p);
+	if (err)
+		cache_release(p);
+}
+
+static void fetch_page(void* udata) {
+	page_job* job = (page_job*)udata;
+	job->ok = find_page(job->key, job->r, job->render, &job->f, 1);
+}
+
+static void send_fetched(sb_Stream* s, void* udata) {
+	page_job* job = (page_job*)udata;
+	admission_end_render();
+	if (job->ok)
+		send_found(s, &job->f);
+	else
+		route_not_found(s);
+	free(job);
+}
+
+// a miss reads the post and templates from disk, so it is rendered on the I/O pool
+// while this loop goes on serving everyone else
+static int send_page(sb_Event* e, const route* r, page_renderer render) {
+	size_t len = strlen(e->path);
+	page_job* job;
+	found_page f;
+	int ok;
+	if (find_page(e->path, r, render, &f, 0)) {
+		send_found(e->stream, &f);
+		return 1;
+	}
+	if (!admission_begin_render()) {
+		admission_shed(e->stream);
+		return 1;
+	}
+	job = malloc(sizeof(*job) + len + 1);
+	if (job) {
+		job->r = r;
+		job->render = render;
+		memcpy(job->key, e->path, len + 1);
+		if (io_defer(e->stream, fetch_page, send_fetched, job))
+			return 1;
+		free(job);
+	}
+	ok = find_page(e->path, r, render, &f, 1);
+	admission_end_render();
+	if (!ok)
+		return 0;
+	send_found(e->stream, &f);
+	return 1;
+}
+
+static int page_route(sb_Event* e, const route* r) {
+	if (!posts_contains(e->path + 1))
+		return 0;
+	return send_page(e, r, render_page);
+}
+
+// a stylesheet that was not there at startup, read on the I/O pool
+typedef struct style_job {
+	const route* r;
+	char* file;
+	char path[];
+} style_job;
+
+static void read_style(void* udata) {
+	style_job* job = (style_job*)udata;
+	job->file = read_file(job->path);
+}
+
+static void send_style(sb_Stream* s, void* udata) {
+	style_job* job = (style_job*)udata;
+	if (job->file) {
+		route_begin(s, job->r);
+		sb_write(s, job->file, strlen(job->file));
+	} else {
+		route_not_found(s);
+	}
+	free(job->file);
+	free(job);
+}
+
+static int style_route(sb_Event* e, const route* r) {
+	style_job* job = malloc(sizeof(*job) + strlen(e->path) + 5);
+	if (!job)
+		return 0;
+	job->r = r;
+	sprintf(job->path, "data%s", e->path);
+	if (io_defer(e->stream, read_style, send_style, job))
+		return 1;
+	read_style(job);
+	if (!job->file) {
+		free(job);
+		return 0;
+	}
+	send_style(e->stream, job);
+	return 1;
+}
+
+static int index_route(sb_Event* e, const route* r) {
+	return send_page(e, r, render_index);
+}
+
+static void load_not_found() {
+	buffer b = { 0 };
+	if (!render_not_found(&b) || !route_set_not_found(b.data, b.len))
+		buffer_free(&b);
+}
+
+static uint32_t hash_template(const char* path) {
+	char* file = read_file(path);
+	uint32_t hash = file ? hash_string(file, strlen(file)) : 0;
+	free(file);
+	return hash;
+}
+
+// picks up new or removed posts, post edits and template edits
+static void refresh_main(void* udata) {
+	static time_t pro_mtime = 0, epi_mtime = 0;
+	time_t now = time(NULL);
+	posts_refresh();
+	if (file_mtime("data/prologue.t") != pro_mtime || file_mtime("data/epilogue.t") != epi_mtime) {
+		pro_mtime = file_mtime("data/prologue.t");
+		epi_mtime = file_mtime("data/epilogue.t");
+		templates = hash_template("data/prologue.t") * 31 + hash_template("data/epilogue.t");
+		load_not_found();
+	}
+	cache_revalidate(page_mtime, templates);
+	if (cache_file && now - last_save >= CACHE_SAVE_INTERVAL) {
+		cache_save(cache_file);
+		last_save = now;
+	}
+	atomic_store_int(&refreshing, 0);
+}
+
+// at most once a second, and on the I/O pool where there is one, so that the stats and
+// the cache file writes never hold up a loop serving requests
+static void refresh() {
+	static time_t last_check = 0;
+	time_t now = time(NULL);
+	if (now == last_check || atomic_load_int(&refreshing))
+		return;
+	last_check = now;
+	atomic_store_int(&refreshing, 1);
+	if (!io_run(refresh_main, NULL))
+		refresh_main(NULL);
+}
+
+static void stop(int sig) {
+	running = 0;
+}
+
+// everything in ./data/ that can be served as-is gets loaded once at startup
+static void load_static_routes() {
+	tinydir_dir dir;
+	if (tinydir_open(&dir, "./data/") == -1)
+		return;
+	while (dir.has_next) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+		if (!file.is_dir && valid_file(file.name, ".css")) {
+			char path[_TINYDIR_FILENAME_MAX + 2];
+			char* body = read_file(file.path);
+			sprintf(path, "/%s", file.name);
+			if (body && !route_add_static(path, "text/css", body, strlen(body)))
+				free(body);
+		}
+		tinydir_next(&dir);
+	}
+	tinydir_close(&dir);
+}
+
+static void release_archive(void* udata) {
+	archive_release((archive*)udata);
+}
+
+// archive mode: every response, 404 included, is prebuilt and sent straight from the mapping
+static void serve_archive(sb_Event* e) {
+	archive* a = NULL;
+	const archive_entry* ent;
+	// a deploy may be swapping the archive out from under this request
+	if (epoch_enter()) {
+		a = (archive*)atomic_load_ptr((void* volatile*)&site);
+		atomic_inc(&a->refs);
+		epoch_exit();
+	}
+	if (!a) {
+		sb_send_status(e->stream, 503, "Service Unavailable");
+		return;
+	}
+	ent = archive_find(a, e->path);
+	if (!ent)
+		ent = archive_find(a, ARCHIVE_NOT_FOUND);
+	if (!ent) {
+		archive_release(a);
+		sb_send_status(e->stream, 404, "Not Found");
+		return;
+	}
+	if (sb_send_raw(e->stream, a->base + ent->head_off, (size_t)ent->head_len,
+		a->base + ent->body_off, (size_t)ent->body_len, release_archive, a))
+		archive_release(a);
+}
+
+// a newly deployed archive replaces the running one; streams still sending from the old one keep it mapped
+static void refresh_archive() {
+	static time_t last_check = 0;
+	time_t now = time(NULL), mtime;
+	archive* a;
+	archive* old = site;
+	if (now == last_check)
+		return;
+	last_check = now;
+	epoch_collect();
+	mtime = file_mtime(archive_file);
+	if (!mtime || mtime == site_mtime)
+		return;
+	a = archive_open(archive_file);
+	if (!a)
+		return;
+	atomic_store_ptr((void* volatile*)&site, a);
+	if (old)
+		epoch_retire(release_archive, old);
+	site_mtime = mtime;
+}
+
+// with worker threads, this thread only accepts connections and hands them out.
+// slot `n` of the worker processes (0 without any) serves from the n-th share of the cpus.
+static void serve(int slot) {
+	if (cpu_count && threads) {
+		worker_set_cpus(cpus, cpu_count, slot * threads);
+	} else if (cpu_count) {
+		pinned = cpus[slot % cpu_count];
+		if (!affinity_pin(pinned)) {
+			fprintf(stderr, "failed to pin to cpu %d\n", pinned);
+			pinned = -1;
+		}
+	}
+	if (!io_start(io_threads) && io_threads)
+		fprintf(stderr, "failed to start I/O threads, reading from disk on the serving threads\n");
+	html_thread_start();
+	if (threads && !worker_start(threads, &opt, policy, &running)) {
+		fprintf(stderr, "failed to start worker threads, serving from one thread\n");
+		threads = 0;
+	}
+	while (running) {
+		int room = admission_room(output_pending());
+		if (threads) {
+			worker_accept(server, 1000, room);
+		} else {
+			sb_set_accepting(server, room > 0);
+			sb_poll_server(server, 1000);
+		}
+		if (site)
+			refresh_archive();
+		else
+			refresh();
+	}
+	io_stop();
+	worker_stop();
+	html_thread_stop();
+}
+
+// the supervisor keeps the shared cache in step with the sources for all workers
+static void supervise() {
+	if (!site) {
+		refresh();
+		shared_revalidate(page_mtime, templates);
+		shared_collect();
+	}
+}
+
+static int loopback(const char* address) {
+	return !strncmp(address, "127.", 4) || !strcmp(address, "::1") || !strncmp(address, "::ffff:127.", 11);
+}
+
+// where this process and its workers run, for checking placement; loopback only
+static int send_stats(sb_Event* e) {
+	buffer b = { 0 };
+	char line[128];
+	int cpu = affinity_cpu();
+	if (!loopback(e->address))
+		return 0;
+	sprintf(line, "pid %d\n", (int)getpid());
+	buffer_append_str(&b, line);
+	admission_stats(&b, output_pending(), io_queued());
+	ratelimit_stats(&b);
+	if (threads) {
+		worker_stats(&b);
+	} else {
+		sprintf(line, "thread cpu %d node %d running-on %d running-on-node %d\n",
+			pinned, pinned != -1 ? affinity_node(pinned) : -1, cpu, cpu != -1 ? affinity_node(cpu) : -1);
+		buffer_append_str(&b, line);
+	}
+	sb_send_status(e->stream, 200, "Hello there");
+	sb_send_header(e->stream, "Content-Type", "text/plain");
+	sb_send_header(e->stream, "Cache-Control", "no-store");
+	sb_write(e->stream, b.data, b.len);
+	buffer_free(&b);
+	return 1;
+}
+
+// without worker threads, the listener is paused as soon as a connection fills the last slot
 static int sandbird_handler(sb_Event* e) {
-	if (e->type == SB_EV_REQUEST) {
-		sb_send_status(e->stream, 200, "Hello there");
-		if (valid_file(e->path, ".md")) {
-			sb_send_header(e->stream, "Content-Type", "text/html");
-			render_page(e->stream, e->path);
+	if (e->type == SB_EV_CONNECT) {
+		admission_connected();
+		if (!threads && !admission_room(output_pending()))
+			sb_set_accepting(e->server, 0);
+		// a client over its connection cap is hung up on before it sends anything
+		if (!ratelimit_connected(e->address))
+			return SB_RES_CLOSE;
+	} else if (e->type == SB_EV_CLOSE) {
+		admission_closed();
+		ratelimit_closed(e->address);
+	} else if (e->type == SB_EV_REQUEST) {
+		if (!strcmp(e->path, STATS_PATH) && send_stats(e))
 			return SB_RES_OK;
-		}
-		if (valid_file(e->path, ".css")) {
-			sb_send_header(e->stream, "Content-Type", "text/css");
-			chdir("data"); //warcrime
-			char* file = read_file(e->path + 1);
-			chdir(".."); //warcrime
-			if (file) {
-				sb_writef(e->stream, file);
-				free(file);
-			} else sb_writef(e->stream, "");
+		if (!ratelimit_request(e->address)) {
+			ratelimit_reject(e->stream);
 			return SB_RES_OK;
 		}
-		if (!strcmp(e->path, "/")) {
-			render_index(e->stream);
+		if (!admission_allow(output_pending())) {
+			admission_shed(e->stream);
 			return SB_RES_OK;
 		}
-		sb_writef(e->stream, "<h1>404. how did we get here?</h1>");
+		if (site)
+			serve_archive(e);
+		else
+			route_dispatch(e);
 	}
 	return SB_RES_OK;
 }
 
-int main() {
+static void usage(const char* argv0) {
+	fprintf(stderr, "usage: %s [-s stale-seconds] [-M seal-bytes] [-c cache-file] [-a archive]\n"
+		"       [-f workers] [-F shared-cache-mb] [-t threads] [-d least-loaded|round-robin]\n"
+		"       [-A cpu-list] [-i io-threads] [-m max-connections] [-r max-renders]\n"
+		"       [-o max-output-bytes] [-b] [-l requests-per-second] [-L connections-per-client]\n"
+		"       [-P parse-budget]\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+	size_t shared_mb = SHARED_CACHE_MB;
 	setlocale(LC_ALL, "");
+	cache_init();
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			cache_set_stale_window(atoi(argv[++i]));
+			shared_set_stale_window(atoi(argv[i]));
+		}
+		else if (!strcmp(argv[i], "-M") && i + 1 < argc)
+			cache_set_seal_threshold(strtoul(argv[++i], NULL, 10));
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			cache_file = argv[++i];
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+			archive_file = argv[++i];
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			workers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-F") && i + 1 < argc)
+			shared_mb = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "least-loaded"))
+				policy = WORKER_LEAST_LOADED;
+			else if (!strcmp(argv[i], "round-robin"))
+				policy = WORKER_ROUND_ROBIN;
+			else
+				usage(argv[0]);
+		}
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			admission_set_connections(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			admission_set_renders(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			admission_set_output(strtoul(argv[++i], NULL, 10));
+		else if (!strcmp(argv[i], "-b"))
+			admission_set_backlog(1);
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			ratelimit_set_rate(strtoul(argv[++i], NULL, 10));
+		else if (!strcmp(argv[i], "-L") && i + 1 < argc)
+			ratelimit_set_connections(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+			html_set_parse_budget(strtoul(argv[++i], NULL, 10));
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			io_threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-A") && i + 1 < argc) {
+			cpu_count = affinity_parse(argv[++i], cpus, AFFINITY_MAX_CPUS);
+			if (!cpu_count)
+				usage(argv[0]);
+		}
+		else
+			usage(argv[0]);
+	}
+	// workers would all write the same cache file
+	if (workers < 0 || threads < 0 || io_threads < 0 || (workers && cache_file))
+		usage(argv[0]);
+
+	if (!ratelimit_init()) {
+		fprintf(stderr, "failed to set up rate limiting\n");
+		exit(EXIT_FAILURE);
+	}
 
-	sb_Options opt;
 	memset(&opt, 0, sizeof(opt));
 	opt.port = "80";
 	opt.handler = sandbird_handler;
 
-	sb_Server* server = sb_new_server(&opt);
+	if (archive_file) {
+		refresh_archive();
+		if (!site) {
+			fprintf(stderr, "failed to open archive %s\n", archive_file);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		route_add("/", "text/html", index_route);
+		route_add("*.md", "text/html", page_route);
+		route_add("*.css", "text/css", style_route);
+		load_static_routes();
+		refresh();
+		if (workers && !shared_init(shared_mb << 20))
+			fprintf(stderr, "failed to set up the shared cache, workers will cache separately\n");
+		shared_revalidate(page_mtime, templates);
+		if (cache_file) {
+			cache_load(cache_file, page_mtime);
+			last_save = time(NULL);
+		}
+	}
+
+	server = sb_new_server(&opt);
 
 	if (!server) {
 		fprintf(stderr, "failed to initialize server\n");
 		exit(EXIT_FAILURE);
 	}
-	for (;;) sb_poll_server(server, 1000);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	if (workers) {
+		prefork_hooks hooks = { serve, supervise, shared_forget };
+		if (!prefork_run(workers, &hooks, &running)) {
+			fprintf(stderr, "worker processes are not supported here\n");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		serve(0);
+	}
+	if (cache_file && !site)
+		cache_save(cache_file);
 	sb_close_server(server);
+	archive_release(site);
+	route_clear();
+	posts_free();
+	cache_free();
+	shared_free();
+	ratelimit_free();
 	return EXIT_SUCCESS;
 															}
\ No newline at end of file
@@ -0,0 +1,821 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+
+
+/***************************
+ ***  Format of the AST  ***
+ ***************************/
+
+/* The AST is the header, followed by the arrays of attribute substrings,
+ * the interned strings and the events.
+ *
+ * Each event starts with a byte made by MD_AST_OP(). Enter and leave events
+ * of blocks and spans having a detail structure are followed by its members,
+ * in the order of their declaration: integers as varints (7 bits a byte,
+ * least significant first), and attributes as described at md_ast_attr().
+ * Text events are followed by the text (see md_ast_text()).
+ */
+#define MD_AST_MAGIC            0x5341444d  /* "MDAS" on a little endian machine. */
+#define MD_AST_VERSION          1
+
+#define MD_AST_ALIGN            8
+#define MD_AST_ROUND(sz)        (((sz) + MD_AST_ALIGN - 1) & ~(size_t) (MD_AST_ALIGN - 1))
+
+typedef struct MD_AST_HEADER_tag MD_AST_HEADER;
+struct MD_AST_HEADER_tag {
+    unsigned magic;
+    unsigned short version;
+    unsigned short char_size;
+    MD_SIZE text_size;
+    MD_SIZE attrs_size;         /* Bytes; a multiple of MD_AST_ALIGN. */
+    MD_SIZE strings_size;       /* Characters. */
+    MD_SIZE events_size;        /* Bytes. */
+};
+
+#define MD_AST_ENTER_BLOCK      0
+#define MD_AST_LEAVE_BLOCK      1
+#define MD_AST_ENTER_SPAN       2
+#define MD_AST_LEAVE_SPAN       3
+#define MD_AST_TEXT             4
+
+/* Types are below 16, leaving a bit for flags. */
+#define MD_AST_OP(kind, type)   (((kind) << 5) | (type))
+#define MD_AST_OP_KIND(op)      ((op) >> 5)
+#define MD_AST_OP_TYPE(op)      ((op) & 0x0f)
+#define MD_AST_OP_INTERNED      0x10        /* Text of MD_AST_TEXT is interned. */
+
+/* Kinds of attribute text. */
+#define MD_AST_ATTR_NULL        0
+#define MD_AST_ATTR_DOC         1
+#define MD_AST_ATTR_INTERNED    2
+
+/* An attribute's substrings are kept as its MD_ATTRIBUTE::substr_offsets,
+ * followed by its MD_ATTRIBUTE::substr_types, from this offset. */
+#define MD_AST_TYPES_OFFSET(n_substrs)                                          \
+        ((((n_substrs) + 1) * sizeof(MD_OFFSET) + sizeof(MD_TEXTTYPE) - 1)      \
+                / sizeof(MD_TEXTTYPE) * sizeof(MD_TEXTTYPE))
+#define MD_AST_SUBSTRS_SIZE(n_substrs)                                          \
+        (MD_AST_TYPES_OFFSET(n_substrs) + (n_substrs) * sizeof(MD_TEXTTYPE))
+
+
+/*******************
+ ***  Recording  ***
+ *******************/
+
+typedef struct MD_AST_BUFFER_tag MD_AST_BUFFER;
+struct MD_AST_BUFFER_tag {
+    char* data;
+    size_t size;
+    size_t alloc;
+};
+
+/* Interned strings and substring arrays are found by their contents in an
+ * open addressing hash table, at most half full. */
+typedef struct MD_AST_SLOT_tag MD_AST_SLOT;
+struct MD_AST_SLOT_tag {
+    unsigned hash;
+    size_t off;                 /* In the buffer. */
+    size_t size;                /* Bytes; zero when the slot is empty. */
+};
+
+typedef struct MD_AST_INTERN_tag MD_AST_INTERN;
+struct MD_AST_INTERN_tag {
+    MD_AST_BUFFER* buffer;
+    MD_AST_SLOT* slots;
+    unsigned n_slots;           /* Power of 2, or 0 until first used. */
+    unsigned n_used;
+};
+
+typedef struct MD_AST_RECORDER_tag MD_AST_RECORDER;
+struct MD_AST_RECORDER_tag {
+    const MD_PARSER* parser;    /* Of the caller. */
+    void* userdata;
+    const MD_CHAR* text;
+    MD_SIZE size;
+
+    MD_AST_BUFFER events;
+    MD_AST_BUFFER attrs;
+    MD_AST_BUFFER strings;
+    MD_AST_INTERN attr_intern;
+    MD_AST_INTERN string_intern;
+
+    MD_OFFSET last_end;         /* Of the last text event in the document. */
+    int error;
+};
+
+static int
+md_ast_reserve(MD_AST_BUFFER* buf, size_t size)
+{
+    if(buf->size + size > buf->alloc) {
+        size_t new_alloc = (buf->alloc > 0) ? buf->alloc : 256;
+        char* new_data;
+
+        while(new_alloc < buf->size + size)
+            new_alloc *= 2;
+        new_data = (char*) realloc(buf->data, new_alloc);
+        if(new_data == NULL)
+            return -1;
+        buf->data = new_data;
+        buf->alloc = new_alloc;
+    }
+    return 0;
+}
+
+static void
+md_ast_put_byte(MD_AST_RECORDER* rec, unsigned char byte)
+{
+    if(md_ast_reserve(&rec->events, 1) != 0) {
+        rec->error = 1;
+        return;
+    }
+    rec->events.data[rec->events.size++] = (char) byte;
+}
+
+static void
+md_ast_put_varint(MD_AST_RECORDER* rec, unsigned val)
+{
+    if(md_ast_reserve(&rec->events, 5) != 0) {
+        rec->error = 1;
+        return;
+    }
+    while(val >= 0x80) {
+        rec->events.data[rec->events.size++] = (char) (0x80 | (val & 0x7f));
+        val >>= 7;
+    }
+    rec->events.data[rec->events.size++] = (char) val;
+}
+
+static unsigned
+md_ast_hash(const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    unsigned hash = 2166136261u;
+    size_t i;
+
+    for(i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the offset in the intern's buffer where a copy of 'data' lives,
+ * appending it (aligned to 'align' bytes) if it is not there yet. */
+static size_t
+md_ast_intern(MD_AST_RECORDER* rec, MD_AST_INTERN* intern, const void* data, size_t size, size_t align)
+{
+    MD_AST_BUFFER* buf = intern->buffer;
+    unsigned hash = md_ast_hash(data, size);
+    MD_AST_SLOT* slot;
+    size_t off;
+
+    if(2 * (intern->n_used + 1) > intern->n_slots) {
+        unsigned n_slots = (intern->n_slots > 0) ? 2 * intern->n_slots : 64;
+        MD_AST_SLOT* slots;
+        unsigned i;
+
+        slots = (MD_AST_SLOT*) calloc(n_slots, sizeof(MD_AST_SLOT));
+        if(slots == NULL) {
+            rec->error = 1;
+            return 0;
+        }
+        for(i = 0; i < intern->n_slots; i++) {
+            if(intern->slots[i].size > 0) {
+                slot = &slots[intern->slots[i].hash & (n_slots - 1)];
+                while(slot->size > 0)
+                    slot = (slot < slots + n_slots - 1) ? slot + 1 : slots;
+                *slot = intern->slots[i];
+            }
+        }
+        free(intern->slots);
+        intern->slots = slots;
+        intern->n_slots = n_slots;
+    }
+
+    slot = &intern->slots[hash & (intern->n_slots - 1)];
+    while(slot->size > 0) {
+        if(slot->hash == hash  &&  slot->size == size  &&
+           memcmp(buf->data + slot->off, data, size) == 0)
+            return slot->off;
+        slot = (slot < intern->slots + intern->n_slots - 1) ? slot + 1 : intern->slots;
+    }
+
+    off = (buf->size + align - 1) / align * align;
+    if(md_ast_reserve(buf, off - buf->size + size) != 0) {
+        rec->error = 1;
+        return 0;
+    }
+    memset(buf->data + buf->size, 0, off - buf->size);
+    memcpy(buf->data + off, data, size);
+    buf->size = off + size;
+
+    slot->hash = hash;
+    slot->off = off;
+    slot->size = size;
+    intern->n_used++;
+    return off;
+}
+
+static int
+md_ast_in_doc(MD_AST_RECORDER* rec, const MD_CHAR* str, MD_SIZE size)
+{
+    return (str >= rec->text  &&  size <= rec->size  &&  str <= rec->text + (rec->size - size));
+}
+
+/* Text in the document is recorded as the distance of its offset from the
+ * end of the text recorded before (zigzag encoded, for it may be negative),
+ * and its size. Interned text is recorded as its offset among the interned
+ * strings, and its size. */
+static void
+md_ast_text(MD_AST_RECORDER* rec, MD_TEXTTYPE type, const MD_CHAR* str, MD_SIZE size)
+{
+    if(md_ast_in_doc(rec, str, size)) {
+        MD_OFFSET off = (MD_OFFSET) (str - rec->text);
+        unsigned delta = off - rec->last_end;
+
+        md_ast_put_byte(rec, MD_AST_OP(MD_AST_TEXT, type));
+        md_ast_put_varint(rec, (delta << 1) ^ (0u - (delta >> 31)));
+        rec->last_end = off + size;
+    } else {
+        size_t off = md_ast_intern(rec, &rec->string_intern, str, size * sizeof(MD_CHAR), sizeof(MD_CHAR));
+
+        md_ast_put_byte(rec, MD_AST_OP(MD_AST_TEXT, type) | MD_AST_OP_INTERNED);
+        md_ast_put_varint(rec, (unsigned) (off / sizeof(MD_CHAR)));
+    }
+    md_ast_put_varint(rec, size);
+}
+
+/* An attribute is recorded as the kind of its text (MD_AST_ATTR_xxx) and,
+ * unless it is NULL, the text's offset (in the document or among interned
+ * strings) and size. Then follow the offset of its interned substring arrays
+ * in units of MD_AST_ALIGN plus one (or zero if it has none) and the number
+ * of substrings. */
+static void
+md_ast_attr(MD_AST_RECORDER* rec, const MD_ATTRIBUTE* attr)
+{
+    unsigned n_substrs = 0;
+
+    if(attr->text == NULL) {
+        md_ast_put_byte(rec, MD_AST_ATTR_NULL);
+    } else if(md_ast_in_doc(rec, attr->text, attr->size)) {
+        md_ast_put_byte(rec, MD_AST_ATTR_DOC);
+        md_ast_put_varint(rec, (unsigned) (attr->text - rec->text));
+        md_ast_put_varint(rec, attr->size);
+    } else {
+        size_t off = md_ast_intern(rec, &rec->string_intern, attr->text,
+                                   attr->size * sizeof(MD_CHAR), sizeof(MD_CHAR));
+
+        md_ast_put_byte(rec, MD_AST_ATTR_INTERNED);
+        md_ast_put_varint(rec, (unsigned) (off / sizeof(MD_CHAR)));
+        md_ast_put_varint(rec, attr->size);
+    }
+
+    if(attr->substr_offsets == NULL) {
+        md_ast_put_varint(rec, 0);
+        return;
+    }
+
+    while(attr->substr_offsets[n_substrs] < attr->size)
+        n_substrs++;
+
+    {
+        /* The arrays are copied next to each other before interning. The
+         * usual attribute has just one substring. */
+        char local[MD_AST_SUBSTRS_SIZE(4)];
+        size_t size = MD_AST_SUBSTRS_SIZE(n_substrs);
+        char* substrs = (size <= sizeof(local)) ? local : (char*) malloc(size);
+        size_t off;
+
+        if(substrs == NULL) {
+            rec->error = 1;
+            return;
+        }
+        memset(substrs, 0, size);
+        memcpy(substrs, attr->substr_offsets, (n_substrs + 1) * sizeof(MD_OFFSET));
+        memcpy(substrs + MD_AST_TYPES_OFFSET(n_substrs), attr->substr_types, n_substrs * sizeof(MD_TEXTTYPE));
+        off = md_ast_intern(rec, &rec->attr_intern, substrs, size, MD_AST_ALIGN);
+        if(substrs != local)
+            free(substrs);
+
+        md_ast_put_varint(rec, (unsigned) (off / MD_AST_ALIGN + 1));
+        md_ast_put_varint(rec, n_substrs);
+    }
+}
+
+static void
+md_ast_block_detail(MD_AST_RECORDER* rec, MD_BLOCKTYPE type, const void* detail)
+{
+    switch(type) {
+        case MD_BLOCK_UL:
+        {
+            const MD_BLOCK_UL_DETAIL* det = (const MD_BLOCK_UL_DETAIL*) detail;
+            md_ast_put_varint(rec, det->is_tight);
+            md_ast_put_varint(rec, det->mark);
+            break;
+        }
+
+        case MD_BLOCK_OL:
+        {
+            const MD_BLOCK_OL_DETAIL* det = (const MD_BLOCK_OL_DETAIL*) detail;
+            md_ast_put_varint(rec, det->start);
+            md_ast_put_varint(rec, det->is_tight);
+            md_ast_put_varint(rec, det->mark_delimiter);
+            break;
+        }
+
+        case MD_BLOCK_LI:
+        {
+            const MD_BLOCK_LI_DETAIL* det = (const MD_BLOCK_LI_DETAIL*) detail;
+            md_ast_put_varint(rec, det->is_task);
+            md_ast_put_varint(rec, det->task_mark);
+            md_ast_put_varint(rec, det->task_mark_offset);
+            break;
+        }
+
+        case MD_BLOCK_H:
+            md_ast_put_varint(rec, ((const MD_BLOCK_H_DETAIL*) detail)->level);
+            break;
+
+        case MD_BLOCK_CODE:
+        {
+            const MD_BLOCK_CODE_DETAIL* det = (const MD_BLOCK_CODE_DETAIL*) detail;
+            md_ast_attr(rec, &det->info);
+            md_ast_attr(rec, &det->lang);
+            md_ast_put_varint(rec, det->fence_char);
+            break;
+        }
+
+        case MD_BLOCK_TH:
+        case MD_BLOCK_TD:
+            md_ast_put_varint(rec, ((const MD_BLOCK_TD_DETAIL*) detail)->align);
+            break;
+
+        default:
+            /* No detail. */
+            break;
+    }
+}
+
+static void
+md_ast_span_detail(MD_AST_RECORDER* rec, MD_SPANTYPE type, const void* detail)
+{
+    switch(type) {
+        case MD_SPAN_A:
+            md_ast_attr(rec, &((const MD_SPAN_A_DETAIL*) detail)->href);
+            md_ast_attr(rec, &((const MD_SPAN_A_DETAIL*) detail)->title);
+            break;
+
+        case MD_SPAN_IMG:
+            md_ast_attr(rec, &((const MD_SPAN_IMG_DETAIL*) detail)->src);
+            md_ast_attr(rec, &((const MD_SPAN_IMG_DETAIL*) detail)->title);
+            break;
+
+        case MD_SPAN_WIKILINK:
+            md_ast_attr(rec, &((const MD_SPAN_WIKILINK_DETAIL*) detail)->target);
+            break;
+
+        default:
+            /* No detail. */
+            break;
+    }
+}
+
+static int
+md_ast_enter_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    md_ast_put_byte(rec, MD_AST_OP(MD_AST_ENTER_BLOCK, type));
+    md_ast_block_detail(rec, type, detail);
+    if(rec->error)
+        return -1;
+    return (rec->parser->enter_block != NULL) ? rec->parser->enter_block(type, detail, rec->userdata) : 0;
+}
+
+static int
+md_ast_leave_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    md_ast_put_byte(rec, MD_AST_OP(MD_AST_LEAVE_BLOCK, type));
+    md_ast_block_detail(rec, type, detail);
+    if(rec->error)
+        return -1;
+    return (rec->parser->leave_block != NULL) ? rec->parser->leave_block(type, detail, rec->userdata) : 0;
+}
+
+static int
+md_ast_enter_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    md_ast_put_byte(rec, MD_AST_OP(MD_AST_ENTER_SPAN, type));
+    md_ast_span_detail(rec, type, detail);
+    if(rec->error)
+        return -1;
+    return (rec->parser->enter_span != NULL) ? rec->parser->enter_span(type, detail, rec->userdata) : 0;
+}
+
+static int
+md_ast_leave_span_callback(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    md_ast_put_byte(rec, MD_AST_OP(MD_AST_LEAVE_SPAN, type));
+    md_ast_span_detail(rec, type, detail);
+    if(rec->error)
+        return -1;
+    return (rec->parser->leave_span != NULL) ? rec->parser->leave_span(type, detail, rec->userdata) : 0;
+}
+
+static int
+md_ast_text_callback(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    md_ast_text(rec, type, text, size);
+    if(rec->error)
+        return -1;
+    return (rec->parser->text != NULL) ? rec->parser->text(type, text, size, rec->userdata) : 0;
+}
+
+static void
+md_ast_debug_log_callback(const char* msg, void* userdata)
+{
+    MD_AST_RECORDER* rec = (MD_AST_RECORDER*) userdata;
+
+    if(rec->parser->debug_log != NULL)
+        rec->parser->debug_log(msg, rec->userdata);
+}
+
+int
+md_ast_record(MD_PARSER_CTX* pctx, const MD_CHAR* text, MD_SIZE size,
+              const MD_PARSER* parser, void* userdata,
+              void** p_ast, size_t* p_size)
+{
+    MD_AST_RECORDER rec;
+    MD_PARSER rec_parser;
+    MD_AST_HEADER header;
+    char* ast = NULL;
+    size_t ast_size = 0;
+    int ret;
+
+    memset(&rec, 0, sizeof(MD_AST_RECORDER));
+    rec.parser = parser;
+    rec.userdata = userdata;
+    rec.text = text;
+    rec.size = size;
+    rec.attr_intern.buffer = &rec.attrs;
+    rec.string_intern.buffer = &rec.strings;
+
+    memcpy(&rec_parser, parser, sizeof(MD_PARSER));
+    rec_parser.enter_block = md_ast_enter_block_callback;
+    rec_parser.leave_block = md_ast_leave_block_callback;
+    rec_parser.enter_span = md_ast_enter_span_callback;
+    rec_parser.leave_span = md_ast_leave_span_callback;
+    rec_parser.text = md_ast_text_callback;
+    rec_parser.debug_log = md_ast_debug_log_callback;
+
+    ret = md_parse_ctx(pctx, text, size, &rec_parser, (void*) &rec);
+    if(ret == 0  &&  rec.error)
+        ret = -1;
+
+    if(ret == 0) {
+        size_t attrs_size = MD_AST_ROUND(rec.attrs.size);
+
+        ast_size = sizeof(MD_AST_HEADER) + attrs_size + rec.strings.size + rec.events.size;
+        ast = (char*) malloc(ast_size);
+        if(ast != NULL) {
+            header.magic = MD_AST_MAGIC;
+            header.version = MD_AST_VERSION;
+            header.char_size = sizeof(MD_CHAR);
+            header.text_size = size;
+            header.attrs_size = (MD_SIZE) attrs_size;
+            header.strings_size = (MD_SIZE) (rec.strings.size / sizeof(MD_CHAR));
+            header.events_size = (MD_SIZE) rec.events.size;
+            memcpy(ast, &header, sizeof(MD_AST_HEADER));
+            memset(ast + sizeof(MD_AST_HEADER), 0, attrs_size);
+            if(rec.attrs.size > 0)
+                memcpy(ast + sizeof(MD_AST_HEADER), rec.attrs.data, rec.attrs.size);
+            if(rec.strings.size > 0)
+                memcpy(ast + sizeof(MD_AST_HEADER) + attrs_size, rec.strings.data, rec.strings.size);
+            memcpy(ast + sizeof(MD_AST_HEADER) + attrs_size + rec.strings.size, rec.events.data, rec.events.size);
+        } else {
+            ast_size = 0;
+            ret = -1;
+        }
+    }
+
+    free(rec.events.data);
+    free(rec.attrs.data);
+    free(rec.strings.data);
+    free(rec.attr_intern.slots);
+    free(rec.string_intern.slots);
+
+    *p_ast = ast;
+    *p_size = ast_size;
+    return ret;
+}
+
+void
+md_ast_free(void* ast)
+{
+    free(ast);
+}
+
+
+/*******************
+ ***  Replaying  ***
+ *******************/
+
+typedef struct MD_AST_READER_tag MD_AST_READER;
+struct MD_AST_READER_tag {
+    const unsigned char* pos;
+    const unsigned char* end;
+    const char* attrs;
+    MD_SIZE attrs_size;
+    const MD_CHAR* strings;
+    MD_SIZE strings_size;
+    const MD_CHAR* text;
+    MD_SIZE size;
+    MD_OFFSET last_end;
+    int error;
+};
+
+static unsigned
+md_ast_get_varint(MD_AST_READER* rd)
+{
+    unsigned val = 0;
+    int shift = 0;
+
+    while(rd->pos < rd->end  &&  shift < 35) {
+        unsigned char byte = *rd->pos++;
+
+        val |= (unsigned) (byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return val;
+        shift += 7;
+    }
+
+    rd->error = 1;
+    return 0;
+}
+
+/* Resolves a string at 'off' of 'size' characters, in the document or among
+ * the interned strings. */
+static const MD_CHAR*
+md_ast_get_str(MD_AST_READER* rd, int interned, MD_SIZE off, MD_SIZE size)
+{
+    const MD_CHAR* base = (interned ? rd->strings : rd->text);
+    MD_SIZE base_size = (interned ? rd->strings_size : rd->size);
+
+    if(off > base_size  ||  size > base_size - off) {
+        rd->error = 1;
+        return NULL;
+    }
+    return base + off;
+}
+
+static void
+md_ast_get_attr(MD_AST_READER* rd, MD_ATTRIBUTE* attr)
+{
+    unsigned kind;
+    unsigned substrs;
+    unsigned n_substrs;
+    unsigned i;
+    size_t off;
+
+    memset(attr, 0, sizeof(MD_ATTRIBUTE));
+
+    kind = (rd->pos < rd->end) ? *rd->pos++ : MD_AST_ATTR_NULL;
+    if(kind == MD_AST_ATTR_DOC  ||  kind == MD_AST_ATTR_INTERNED) {
+        MD_SIZE str_off = md_ast_get_varint(rd);
+
+        attr->size = md_ast_get_varint(rd);
+        attr->text = md_ast_get_str(rd, (kind == MD_AST_ATTR_INTERNED), str_off, attr->size);
+    } else if(kind != MD_AST_ATTR_NULL) {
+        rd->error = 1;
+    }
+
+    substrs = md_ast_get_varint(rd);
+    if(substrs == 0)
+        return;
+    n_substrs = md_ast_get_varint(rd);
+
+    /* The arrays must be there and describe the text. */
+    off = (size_t) (substrs - 1) * MD_AST_ALIGN;
+    if(n_substrs > rd->attrs_size  ||  off > rd->attrs_size  ||
+       MD_AST_SUBSTRS_SIZE(n_substrs) > rd->attrs_size - off) {
+        rd->error = 1;
+        return;
+    }
+    attr->substr_offsets = (const MD_OFFSET*) (rd->attrs + off);
+    attr->substr_types = (const MD_TEXTTYPE*) (rd->attrs + off + MD_AST_TYPES_OFFSET(n_substrs));
+    if(attr->substr_offsets[0] != 0  ||  attr->substr_offsets[n_substrs] != attr->size)
+        rd->error = 1;
+    for(i = 0; i < n_substrs; i++) {
+        if(attr->substr_offsets[i] >= attr->substr_offsets[i+1]  ||  attr->substr_types[i] > MD_TEXT_LATEXMATH)
+            rd->error = 1;
+    }
+}
+
+int
+md_ast_replay(const void* ast, size_t ast_size,
+              const MD_CHAR* text, MD_SIZE size,
+              const MD_PARSER* parser, void* userdata)
+{
+    MD_AST_HEADER header;
+    MD_AST_READER rd;
+    union {
+        MD_BLOCK_UL_DETAIL ul;
+        MD_BLOCK_OL_DETAIL ol;
+        MD_BLOCK_LI_DETAIL li;
+        MD_BLOCK_H_DETAIL h;
+        MD_BLOCK_CODE_DETAIL code;
+        MD_BLOCK_TD_DETAIL td;
+        MD_SPAN_A_DETAIL a;
+        MD_SPAN_IMG_DETAIL img;
+        MD_SPAN_WIKILINK_DETAIL wikilink;
+    } det;
+    int ret = 0;
+
+    if(ast_size < sizeof(MD_AST_HEADER))
+        return -1;
+    memcpy(&header, ast, sizeof(MD_AST_HEADER));
+    if(header.magic != MD_AST_MAGIC  ||  header.version != MD_AST_VERSION  ||
+       header.char_size != sizeof(MD_CHAR)  ||  header.text_size != size  ||
+       header.attrs_size % MD_AST_ALIGN != 0  ||
+       ast_size != sizeof(MD_AST_HEADER) + (size_t) header.attrs_size +
+                   (size_t) header.strings_size * sizeof(MD_CHAR) + header.events_size)
+        return -1;
+
+    rd.attrs = (const char*) ast + sizeof(MD_AST_HEADER);
+    rd.attrs_size = header.attrs_size;
+    rd.strings = (const MD_CHAR*) (rd.attrs + header.attrs_size);
+    rd.strings_size = header.strings_size;
+    rd.pos = (const unsigned char*) (rd.strings + header.strings_size);
+    rd.end = rd.pos + header.events_size;
+    rd.text = text;
+    rd.size = size;
+    rd.last_end = 0;
+    rd.error = 0;
+
+    while(rd.pos < rd.end) {
+        unsigned op = *rd.pos++;
+        unsigned type = MD_AST_OP_TYPE(op);
+        void* detail = NULL;
+
+        switch(MD_AST_OP_KIND(op)) {
+            case MD_AST_ENTER_BLOCK:
+            case MD_AST_LEAVE_BLOCK:
+                switch(type) {
+                    case MD_BLOCK_UL:
+                        det.ul.is_tight = md_ast_get_varint(&rd);
+                        det.ul.mark = (MD_CHAR) md_ast_get_varint(&rd);
+                        detail = &det;
+                        break;
+
+                    case MD_BLOCK_OL:
+                        det.ol.start = md_ast_get_varint(&rd);
+                        det.ol.is_tight = md_ast_get_varint(&rd);
+                        det.ol.mark_delimiter = (MD_CHAR) md_ast_get_varint(&rd);
+                        detail = &det;
+                        break;
+
+                    case MD_BLOCK_LI:
+                        det.li.is_task = md_ast_get_varint(&rd);
+                        det.li.task_mark = (MD_CHAR) md_ast_get_varint(&rd);
+                        det.li.task_mark_offset = md_ast_get_varint(&rd);
+                        detail = &det;
+                        break;
+
+                    case MD_BLOCK_H:
+                        det.h.level = md_ast_get_varint(&rd);
+                        detail = &det;
+                        break;
+
+                    case MD_BLOCK_CODE:
+                        md_ast_get_attr(&rd, &det.code.info);
+                        md_ast_get_attr(&rd, &det.code.lang);
+                        det.code.fence_char = (MD_CHAR) md_ast_get_varint(&rd);
+                        detail = &det;
+                        break;
+
+                    case MD_BLOCK_TH:
+                    case MD_BLOCK_TD:
+                        det.td.align = (MD_ALIGN) md_ast_get_varint(&rd);
+                        if(det.td.align > MD_ALIGN_RIGHT)
+                            rd.error = 1;
+                        detail = &det;
+                        break;
+
+                    default:
+                        if(type > MD_BLOCK_TD)
+                            rd.error = 1;
+                        break;
+                }
+                if(rd.error)
+                    break;
+                if(MD_AST_OP_KIND(op) == MD_AST_ENTER_BLOCK)
+                    ret = parser->enter_block((MD_BLOCKTYPE) type, detail, userdata);
+                else
+                    ret = parser->leave_block((MD_BLOCKTYPE) type, detail, userdata);
+                break;
+
+            case MD_AST_ENTER_SPAN:
+            case MD_AST_LEAVE_SPAN:
+                switch(type) {
+                    case MD_SPAN_A:
+                        md_ast_get_attr(&rd, &det.a.href);
+                        md_ast_get_attr(&rd, &det.a.title);
+                        detail = &det;
+                        break;
+
+                    case MD_SPAN_IMG:
+                        md_ast_get_attr(&rd, &det.img.src);
+                        md_ast_get_attr(&rd, &det.img.title);
+                        detail = &det;
+                        break;
+
+                    case MD_SPAN_WIKILINK:
+                        md_ast_get_attr(&rd, &det.wikilink.target);
+                        detail = &det;
+                        break;
+
+                    default:
+                        if(type > MD_SPAN_WIKILINK)
+                            rd.error = 1;
+                        break;
+                }
+                if(rd.error)
+                    break;
+                if(MD_AST_OP_KIND(op) == MD_AST_ENTER_SPAN)
+                    ret = parser->enter_span((MD_SPANTYPE) type, detail, userdata);
+                else
+                    ret = parser->leave_span((MD_SPANTYPE) type, detail, userdata);
+                break;
+
+            case MD_AST_TEXT:
+            {
+                const MD_CHAR* str;
+                MD_OFFSET off;
+                MD_SIZE str_size;
+
+                if(op & MD_AST_OP_INTERNED) {
+                    off = md_ast_get_varint(&rd);
+                } else {
+                    unsigned zigzag = md_ast_get_varint(&rd);
+                    off = rd.last_end + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+                }
+                str_size = md_ast_get_varint(&rd);
+                str = md_ast_get_str(&rd, (op & MD_AST_OP_INTERNED), off, str_size);
+                if(type > MD_TEXT_LATEXMATH)
+                    rd.error = 1;
+                if(rd.error)
+                    break;
+                if(!(op & MD_AST_OP_INTERNED))
+                    rd.last_end = off + str_size;
+                ret = parser->text((MD_TEXTTYPE) type, str, str_size, userdata);
+                break;
+            }
+
+            default:
+                rd.error = 1;
+                break;
+        }
+
+        if(rd.error)
+            return -1;
+        if(ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MD4C_AST_H
+#define MD4C_AST_H
+
+#include "md4c.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+
+/* Binary AST: a recording of the events md_parse() produces, which can be
+ * replayed into any set of MD_PARSER callbacks later, as many times as
+ * needed, without parsing the document again.
+ *
+ * The AST refers to the document by offsets, so replaying it needs the very
+ * same text. Strings which are not in the text (e.g. attributes with escapes
+ * resolved, or the "\n" of line breaks) are kept in the AST itself, each of
+ * them only once. The AST holds no pointers, so it may be stored as it is,
+ * e.g. in a file next to a rendered page, and loaded anywhere in memory as
+ * long as it is aligned to 8 bytes (as memory from malloc() or mmap() is).
+ *
+ * The format is native to the machine and the build of MD4C which wrote it:
+ * md_ast_replay() refuses an AST of other version, byte order or MD_CHAR.
+ */
+
+/* Parse the document the same way as md_parse_ctx() does, and record it.
+ * The events are passed on to the callbacks of 'parser' as they come; any
+ * of the callbacks may be NULL to just record the document.
+ *
+ * On success, '*p_ast' points to the AST of '*p_size' bytes, which is to be
+ * released with md_ast_free(). Returns what md_parse() does, and -1 also if
+ * recording runs out of memory; '*p_ast' is then NULL.
+ */
+int md_ast_record(MD_PARSER_CTX* pctx, const MD_CHAR* text, MD_SIZE size,
+                  const MD_PARSER* parser, void* userdata,
+                  void** p_ast, size_t* p_size);
+
+void md_ast_free(void* ast);
+
+/* Replay the AST of the document 'text' into the callbacks of 'parser' (its
+ * other members are ignored). Returns 0 on success, -1 if the AST is damaged
+ * or was recorded from a text of other size, or the return value of the first
+ * callback returning non-zero.
+ */
+int md_ast_replay(const void* ast, size_t ast_size,
+                  const MD_CHAR* text, MD_SIZE size,
+                  const MD_PARSER* parser, void* userdata);
+
+
+#ifdef __cplusplus
+    }  /* extern "C" { */
+#endif
+
+#endif  /* MD4C_AST_H */
@@ -0,0 +1,189 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Builds entity_table.h, the lookup table of entity.c, from entity.def.
+ *
+ * The table is a minimal perfect hash, made with the "hash and displace"
+ * method: names are hashed into buckets of about four, and for each bucket,
+ * largest first, a displacement is searched for which sends all its names
+ * to slots still free. Looking up a name then takes one hash and one compare.
+ *
+ * Usage: entity_gen <output file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "entity.h"
+#include "entity_hash.h"
+
+
+static const struct entity entities[] = {
+#define ENTITY(name, cp0, cp1)      { name, { cp0, cp1 } },
+#include "entity.def"
+#undef ENTITY
+};
+
+#define ENTITY_COUNT        ((unsigned) (sizeof(entities) / sizeof(entities[0])))
+#define MAX_DISPLACEMENT    0xffff
+
+static unsigned hashes[ENTITY_COUNT];
+static int slot_of[ENTITY_COUNT];           /* entity -> slot */
+static int entity_at[ENTITY_COUNT];         /* slot -> entity */
+static unsigned displacement[ENTITY_COUNT];
+static unsigned bucket_size[ENTITY_COUNT];
+static unsigned order[ENTITY_COUNT];
+
+static unsigned n_buckets;
+
+static int
+cmp_bucket_size(const void* a, const void* b)
+{
+    unsigned ba = *(const unsigned*) a;
+    unsigned bb = *(const unsigned*) b;
+
+    if(bucket_size[ba] != bucket_size[bb])
+        return (bucket_size[ba] > bucket_size[bb]) ? -1 : +1;
+    return (ba < bb) ? -1 : +1;
+}
+
+/* Returns 0 if some bucket has no displacement placing all its names. */
+static int
+place(void)
+{
+    unsigned i, b, d, j, k;
+    int members[64];
+    unsigned slots[64];
+
+    for(i = 0; i < ENTITY_COUNT; i++)
+        entity_at[i] = -1;
+    memset(bucket_size, 0, sizeof(bucket_size));
+    for(i = 0; i < ENTITY_COUNT; i++)
+        bucket_size[hashes[i] % n_buckets]++;
+    for(b = 0; b < n_buckets; b++) {
+        order[b] = b;
+        if(bucket_size[b] > sizeof(members) / sizeof(members[0]))
+            return 0;
+    }
+    qsort(order, n_buckets, sizeof(unsigned), cmp_bucket_size);
+
+    for(i = 0; i < n_buckets; i++) {
+        unsigned n = 0;
+
+        b = order[i];
+        displacement[b] = 0;
+        if(bucket_size[b] == 0)
+            continue;
+        for(j = 0; j < ENTITY_COUNT; j++) {
+            if(hashes[j] % n_buckets == b)
+                members[n++] = (int) j;
+        }
+
+        for(d = 0; d <= MAX_DISPLACEMENT; d++) {
+            for(j = 0; j < n; j++) {
+                slots[j] = entity_mix(hashes[members[j]], d) % ENTITY_COUNT;
+                if(entity_at[slots[j]] != -1)
+                    break;
+                for(k = 0; k < j; k++) {
+                    if(slots[k] == slots[j])
+                        break;
+                }
+                if(k < j)
+                    break;
+            }
+            if(j == n)
+                break;
+        }
+        if(d > MAX_DISPLACEMENT)
+            return 0;
+
+        displacement[b] = d;
+        for(j = 0; j < n; j++) {
+            entity_at[slots[j]] = members[j];
+            slot_of[members[j]] = (int) slots[j];
+        }
+    }
+
+    return 1;
+}
+
+int
+main(int argc, char** argv)
+{
+    FILE* out;
+    unsigned i;
+
+    if(argc != 2) {
+        fprintf(stderr, "Usage: entity_gen <output file>\n");
+        return 1;
+    }
+
+    for(i = 0; i < ENTITY_COUNT; i++)
+        hashes[i] = entity_hash(entities[i].name, strlen(entities[i].name));
+
+    /* Fewer buckets make a smaller table but a harder search. */
+    for(n_buckets = ENTITY_COUNT / 4; n_buckets <= ENTITY_COUNT; n_buckets += ENTITY_COUNT / 32) {
+        if(place())
+            break;
+    }
+    if(n_buckets > ENTITY_COUNT) {
+        fprintf(stderr, "entity_gen: no perfect hash found\n");
+        return 1;
+    }
+
+    out = fopen(argv[1], "w");
+    if(out == NULL) {
+        fprintf(stderr, "entity_gen: cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by entity_gen.c from entity.def. Do not edit. */\n\n");
+    fprintf(out, "#define ENTITY_COUNT        %u\n", ENTITY_COUNT);
+    fprintf(out, "#define ENTITY_BUCKETS      %u\n\n", n_buckets);
+
+    fprintf(out, "static const unsigned short entity_displacement[ENTITY_BUCKETS] = {");
+    for(i = 0; i < n_buckets; i++)
+        fprintf(out, "%s%u,", (i % 16 == 0) ? "\n    " : " ", displacement[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const unsigned char entity_name_size[ENTITY_COUNT] = {");
+    for(i = 0; i < ENTITY_COUNT; i++)
+        fprintf(out, "%s%u,", (i % 16 == 0) ? "\n    " : " ", (unsigned) strlen(entities[entity_at[i]].name));
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const struct entity entity_table[ENTITY_COUNT] = {\n");
+    for(i = 0; i < ENTITY_COUNT; i++) {
+        const struct entity* ent = &entities[entity_at[i]];
+        fprintf(out, "    { \"%s\", { %u, %u } },\n", ent->name, ent->codepoints[0], ent->codepoints[1]);
+    }
+    fprintf(out, "};\n");
+
+    if(fclose(out) != 0) {
+        fprintf(stderr, "entity_gen: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
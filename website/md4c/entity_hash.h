@@ -0,0 +1,71 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MD2HTML_ENTITY_HASH_H
+#define MD2HTML_ENTITY_HASH_H
+
+#include <stdlib.h>
+
+
+/* The hashing shared by entity_lookup() and entity_gen.c, which builds the
+ * table it looks into. An entity name is hashed once; the hash picks a
+ * bucket, and mixed with the displacement the generator found for that
+ * bucket it gives the entity's own slot in the table. */
+
+#ifdef _MSC_VER
+    #define ENTITY_INLINE       __inline
+#else
+    #define ENTITY_INLINE       inline
+#endif
+
+/* FNV-1a */
+static ENTITY_INLINE unsigned
+entity_hash(const char* name, size_t name_size)
+{
+    unsigned h = 2166136261u;
+    size_t i;
+
+    for(i = 0; i < name_size; i++) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* The finalizer of MurmurHash3, seeded with the displacement. */
+static ENTITY_INLINE unsigned
+entity_mix(unsigned h, unsigned displacement)
+{
+    h ^= displacement * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+
+#endif  /* MD2HTML_ENTITY_HASH_H */
@@ -30,6 +30,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Mark characters are searched for 16 bytes at a time where the CPU allows.
+ * Only 8-bit encodings are vectorized; define MD4C_NO_SIMD to keep the plain loop. */
+#if !defined MD4C_USE_UTF16  &&  !defined MD4C_NO_SIMD
+    #if defined __x86_64__  ||  defined _M_X64
+        #define MD_SIMD_X86     1
+        #include <immintrin.h>
+        #ifdef _MSC_VER
+            #include <intrin.h>
+        #endif
+    #endif
+#endif
+#if defined MD_SIMD_X86
+    #define MD_SIMD         1
+#endif
+
 
 /*****************************
  ***  Miscellaneous Stuff  ***
@@ -77,6 +92,7 @@ typedef struct MD_MARK_tag MD_MARK;
 typedef struct MD_BLOCK_tag MD_BLOCK;
 typedef struct MD_CONTAINER_tag MD_CONTAINER;
 typedef struct MD_REF_DEF_tag MD_REF_DEF;
+typedef struct MD_REF_DEF_SLOT_tag MD_REF_DEF_SLOT;
 
 
 /* During analyzes of inline marks, we need to manage some "mark chains",
@@ -101,6 +117,13 @@ struct MD_CTX_tag {
     /* When this is true, it allows some optimizations. */
     int doc_ends_with_newline;
 
+    /* Allocators of the memory behind MD_MALLOC() and MD_WORK_REALLOC(). */
+    const MD_ALLOCATOR* alloc;
+    const MD_ALLOCATOR* work_alloc;
+
+    /* What is left of MD_PARSER::budget (unless it is zero). */
+    SZ budget;
+
     /* Helper temporary growing buffer. */
     CHAR* buffer;
     unsigned alloc_buffer;
@@ -109,8 +132,9 @@ struct MD_CTX_tag {
     MD_REF_DEF* ref_defs;
     int n_ref_defs;
     int alloc_ref_defs;
-    void** ref_def_hashtable;
-    int ref_def_hashtable_size;
+    MD_REF_DEF_SLOT* ref_def_hashtable;
+    int ref_def_hashtable_size;     /* Power of 2, or 0 when not built. */
+    int alloc_ref_def_hashtable;
 
     /* Stack of inline/span markers.
      * This is only used for parsing a single block contents but by storing it
@@ -125,6 +149,11 @@ struct MD_CTX_tag {
 #else
     char mark_char_map[256];
 #endif
+#ifdef MD_SIMD
+    /* The same set laid out for the vectorized scanners; see md_build_mark_scanner(). */
+    unsigned char mark_nibble_map[16];
+#endif
+    OFF (*skip_non_marks)(MD_CTX* ctx, OFF off, OFF end);
 
     /* For resolving of inline spans. */
     MD_MARKCHAIN mark_chains[12];
@@ -145,9 +174,16 @@ struct MD_CTX_tag {
 
     int n_table_cell_boundaries;
 
+    /* For table processing: column alignments and cell boundaries of a row. */
+    MD_ALIGN* table_align;
+    int alloc_table_align;
+    OFF* table_pipe_offs;
+    int alloc_table_pipe_offs;
+
     /* For resolving links. */
     int unresolved_link_head;
     int unresolved_link_tail;
+    int line_hint;      /* Where md_find_line() starts looking. */
 
     /* For resolving raw HTML. */
     OFF html_comment_horizon;
@@ -232,6 +268,14 @@ struct MD_VERBATIMLINE_tag {
             ctx->parser.debug_log((msg), ctx->userdata);                \
     } while(0)
 
+/* Memory which lives no longer than the document. */
+#define MD_MALLOC(sz)           ctx->alloc->alloc((sz), ctx->alloc->userdata)
+#define MD_REALLOC(ptr, sz)     ctx->alloc->resize((ptr), (sz), ctx->alloc->userdata)
+#define MD_FREE(ptr)            ctx->alloc->release((ptr), ctx->alloc->userdata)
+
+/* Working memory, which may be kept for the next document. */
+#define MD_WORK_REALLOC(ptr, sz)    ctx->work_alloc->resize((ptr), (sz), ctx->work_alloc->userdata)
+
 #ifdef DEBUG
     #define MD_ASSERT(cond)                                             \
             do {                                                        \
@@ -342,8 +386,16 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
     int ret = 0;
 
     while(1) {
+#ifdef MD4C_USE_UTF16
         while(off < size  &&  str[off] != _T('\0'))
             off++;
+#else
+        /* Code blocks go through here whole, so let the C library do the search. */
+        {
+            const CHAR* nul = (const CHAR*) memchr(str + off, '\0', size - off);
+            off = (nul != NULL) ? (OFF) (nul - str) : size;
+        }
+#endif
 
         if(off > 0) {
             ret = ctx->parser.text(type, str, off, ctx->userdata);
@@ -374,13 +426,27 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
     } while(0)
 
 
+/* Charge 'cost' units against MD_PARSER::budget; gives up if it is used up. */
+#define MD_SPEND(cost)                                                  \
+    do {                                                                \
+        if(ctx->parser.budget != 0) {                                   \
+            if((SZ)(cost) > ctx->budget) {                              \
+                MD_LOG("Work budget exceeded.");                        \
+                ret = MD_BUDGET_EXCEEDED;                               \
+                goto abort;                                             \
+            }                                                           \
+            ctx->budget -= (SZ)(cost);                                  \
+        }                                                               \
+    } while(0)
+
+
 #define MD_TEMP_BUFFER(sz)                                              \
     do {                                                                \
         if(sz > ctx->alloc_buffer) {                                    \
             CHAR* new_buffer;                                           \
             SZ new_size = ((sz) + (sz) / 2 + 128) & ~127;               \
                                                                         \
-            new_buffer = realloc(ctx->buffer, new_size);                \
+            new_buffer = MD_WORK_REALLOC(ctx->buffer, new_size);        \
             if(new_buffer == NULL) {                                    \
                 MD_LOG("realloc() failed.");                            \
                 ret = -1;                                               \
@@ -465,209 +531,59 @@ struct MD_UNICODE_FOLD_INFO_tag {
 
 
 #if defined MD4C_USE_UTF16 || defined MD4C_USE_UTF8
-    /* Binary search over sorted "map" of codepoints. Consecutive sequences
-     * of codepoints may be encoded in the map by just using the
-     * (MIN_CODEPOINT | 0x40000000) and (MAX_CODEPOINT | 0x80000000).
-     *
-     * Returns index of the found record in the map (in the case of ranges,
-     * the minimal value is used); or -1 on failure. */
-    static int
-    md_unicode_bsearch__(unsigned codepoint, const unsigned* map, size_t map_size)
+    /* A record of MD_UNICODE_FOLDS[]. For a single codepoint, codepoints[0]
+     * is what to add to the folded one (modulo 2^32), so that a range of
+     * letters shares one record. */
+    typedef struct MD_UNICODE_FOLD_tag MD_UNICODE_FOLD;
+    struct MD_UNICODE_FOLD_tag {
+        unsigned n_codepoints;
+        unsigned codepoints[3];
+    };
+
+    /* Two-stage tables built by unicode_gen from unicode_map.h. */
+    #include "unicode_table.h"
+
+    /* Returns the bits MD_UNICODE_WHITESPACE and MD_UNICODE_PUNCT of the
+     * codepoint, and its index into MD_UNICODE_FOLDS[] shifted up by
+     * MD_UNICODE_FOLD_SHIFT. Zero for all past MD_UNICODE_LIMIT. */
+    static inline unsigned
+    md_unicode_info__(unsigned codepoint)
     {
-        int beg, end;
-        int pivot_beg, pivot_end;
-
-        beg = 0;
-        end = (int) map_size-1;
-        while(beg <= end) {
-            /* Pivot may be a range, not just a single value. */
-            pivot_beg = pivot_end = (beg + end) / 2;
-            if(map[pivot_end] & 0x40000000)
-                pivot_end++;
-            if(map[pivot_beg] & 0x80000000)
-                pivot_beg--;
-
-            if(codepoint < (map[pivot_beg] & 0x00ffffff))
-                end = pivot_beg - 1;
-            else if(codepoint > (map[pivot_end] & 0x00ffffff))
-                beg = pivot_end + 1;
-            else
-                return pivot_beg;
-        }
+        unsigned block;
 
-        return -1;
+        if(codepoint >= MD_UNICODE_LIMIT)
+            return 0;
+        block = MD_UNICODE_BLOCKS[codepoint >> MD_UNICODE_BLOCK_SHIFT];
+        return MD_UNICODE_ENTRIES[(block << MD_UNICODE_BLOCK_SHIFT) |
+                                  (codepoint & ((1 << MD_UNICODE_BLOCK_SHIFT) - 1))];
     }
 
     static int
     md_is_unicode_whitespace__(unsigned codepoint)
     {
-#define R(cp_min, cp_max)   ((cp_min) | 0x40000000), ((cp_max) | 0x80000000)
-#define S(cp)               (cp)
-        /* Unicode "Zs" category.
-         * (generated by scripts/build_whitespace_map.py) */
-        static const unsigned WHITESPACE_MAP[] = {
-            S(0x0020), S(0x00a0), S(0x1680), R(0x2000,0x200a), S(0x202f), S(0x205f), S(0x3000)
-        };
-#undef R
-#undef S
-
         /* The ASCII ones are the most frequently used ones, also CommonMark
          * specification requests few more in this range. */
         if(codepoint <= 0x7f)
             return ISWHITESPACE_(codepoint);
 
-        return (md_unicode_bsearch__(codepoint, WHITESPACE_MAP, SIZEOF_ARRAY(WHITESPACE_MAP)) >= 0);
+        return (md_unicode_info__(codepoint) & MD_UNICODE_WHITESPACE);
     }
 
     static int
     md_is_unicode_punct__(unsigned codepoint)
     {
-#define R(cp_min, cp_max)   ((cp_min) | 0x40000000), ((cp_max) | 0x80000000)
-#define S(cp)               (cp)
-        /* Unicode "Pc", "Pd", "Pe", "Pf", "Pi", "Po", "Ps" categories.
-         * (generated by scripts/build_punct_map.py) */
-        static const unsigned PUNCT_MAP[] = {
-            R(0x0021,0x0023), R(0x0025,0x002a), R(0x002c,0x002f), R(0x003a,0x003b), R(0x003f,0x0040),
-            R(0x005b,0x005d), S(0x005f), S(0x007b), S(0x007d), S(0x00a1), S(0x00a7), S(0x00ab), R(0x00b6,0x00b7),
-            S(0x00bb), S(0x00bf), S(0x037e), S(0x0387), R(0x055a,0x055f), R(0x0589,0x058a), S(0x05be), S(0x05c0),
-            S(0x05c3), S(0x05c6), R(0x05f3,0x05f4), R(0x0609,0x060a), R(0x060c,0x060d), S(0x061b), R(0x061e,0x061f),
-            R(0x066a,0x066d), S(0x06d4), R(0x0700,0x070d), R(0x07f7,0x07f9), R(0x0830,0x083e), S(0x085e),
-            R(0x0964,0x0965), S(0x0970), S(0x09fd), S(0x0a76), S(0x0af0), S(0x0c77), S(0x0c84), S(0x0df4), S(0x0e4f),
-            R(0x0e5a,0x0e5b), R(0x0f04,0x0f12), S(0x0f14), R(0x0f3a,0x0f3d), S(0x0f85), R(0x0fd0,0x0fd4),
-            R(0x0fd9,0x0fda), R(0x104a,0x104f), S(0x10fb), R(0x1360,0x1368), S(0x1400), S(0x166e), R(0x169b,0x169c),
-            R(0x16eb,0x16ed), R(0x1735,0x1736), R(0x17d4,0x17d6), R(0x17d8,0x17da), R(0x1800,0x180a),
-            R(0x1944,0x1945), R(0x1a1e,0x1a1f), R(0x1aa0,0x1aa6), R(0x1aa8,0x1aad), R(0x1b5a,0x1b60),
-            R(0x1bfc,0x1bff), R(0x1c3b,0x1c3f), R(0x1c7e,0x1c7f), R(0x1cc0,0x1cc7), S(0x1cd3), R(0x2010,0x2027),
-            R(0x2030,0x2043), R(0x2045,0x2051), R(0x2053,0x205e), R(0x207d,0x207e), R(0x208d,0x208e),
-            R(0x2308,0x230b), R(0x2329,0x232a), R(0x2768,0x2775), R(0x27c5,0x27c6), R(0x27e6,0x27ef),
-            R(0x2983,0x2998), R(0x29d8,0x29db), R(0x29fc,0x29fd), R(0x2cf9,0x2cfc), R(0x2cfe,0x2cff), S(0x2d70),
-            R(0x2e00,0x2e2e), R(0x2e30,0x2e4f), R(0x3001,0x3003), R(0x3008,0x3011), R(0x3014,0x301f), S(0x3030),
-            S(0x303d), S(0x30a0), S(0x30fb), R(0xa4fe,0xa4ff), R(0xa60d,0xa60f), S(0xa673), S(0xa67e),
-            R(0xa6f2,0xa6f7), R(0xa874,0xa877), R(0xa8ce,0xa8cf), R(0xa8f8,0xa8fa), S(0xa8fc), R(0xa92e,0xa92f),
-            S(0xa95f), R(0xa9c1,0xa9cd), R(0xa9de,0xa9df), R(0xaa5c,0xaa5f), R(0xaade,0xaadf), R(0xaaf0,0xaaf1),
-            S(0xabeb), R(0xfd3e,0xfd3f), R(0xfe10,0xfe19), R(0xfe30,0xfe52), R(0xfe54,0xfe61), S(0xfe63), S(0xfe68),
-            R(0xfe6a,0xfe6b), R(0xff01,0xff03), R(0xff05,0xff0a), R(0xff0c,0xff0f), R(0xff1a,0xff1b),
-            R(0xff1f,0xff20), R(0xff3b,0xff3d), S(0xff3f), S(0xff5b), S(0xff5d), R(0xff5f,0xff65), R(0x10100,0x10102),
-            S(0x1039f), S(0x103d0), S(0x1056f), S(0x10857), S(0x1091f), S(0x1093f), R(0x10a50,0x10a58), S(0x10a7f),
-            R(0x10af0,0x10af6), R(0x10b39,0x10b3f), R(0x10b99,0x10b9c), R(0x10f55,0x10f59), R(0x11047,0x1104d),
-            R(0x110bb,0x110bc), R(0x110be,0x110c1), R(0x11140,0x11143), R(0x11174,0x11175), R(0x111c5,0x111c8),
-            S(0x111cd), S(0x111db), R(0x111dd,0x111df), R(0x11238,0x1123d), S(0x112a9), R(0x1144b,0x1144f),
-            S(0x1145b), S(0x1145d), S(0x114c6), R(0x115c1,0x115d7), R(0x11641,0x11643), R(0x11660,0x1166c),
-            R(0x1173c,0x1173e), S(0x1183b), S(0x119e2), R(0x11a3f,0x11a46), R(0x11a9a,0x11a9c), R(0x11a9e,0x11aa2),
-            R(0x11c41,0x11c45), R(0x11c70,0x11c71), R(0x11ef7,0x11ef8), S(0x11fff), R(0x12470,0x12474),
-            R(0x16a6e,0x16a6f), S(0x16af5), R(0x16b37,0x16b3b), S(0x16b44), R(0x16e97,0x16e9a), S(0x16fe2),
-            S(0x1bc9f), R(0x1da87,0x1da8b), R(0x1e95e,0x1e95f)
-        };
-#undef R
-#undef S
-
         /* The ASCII ones are the most frequently used ones, also CommonMark
          * specification requests few more in this range. */
         if(codepoint <= 0x7f)
             return ISPUNCT_(codepoint);
 
-        return (md_unicode_bsearch__(codepoint, PUNCT_MAP, SIZEOF_ARRAY(PUNCT_MAP)) >= 0);
+        return (md_unicode_info__(codepoint) & MD_UNICODE_PUNCT);
     }
 
     static void
     md_get_unicode_fold_info(unsigned codepoint, MD_UNICODE_FOLD_INFO* info)
     {
-#define R(cp_min, cp_max)   ((cp_min) | 0x40000000), ((cp_max) | 0x80000000)
-#define S(cp)               (cp)
-        /* Unicode "Pc", "Pd", "Pe", "Pf", "Pi", "Po", "Ps" categories.
-         * (generated by scripts/build_punct_map.py) */
-        static const unsigned FOLD_MAP_1[] = {
-            R(0x0041,0x005a), S(0x00b5), R(0x00c0,0x00d6), R(0x00d8,0x00de), R(0x0100,0x012e), R(0x0132,0x0136),
-            R(0x0139,0x0147), R(0x014a,0x0176), S(0x0178), R(0x0179,0x017d), S(0x017f), S(0x0181), S(0x0182),
-            S(0x0186), S(0x0187), S(0x0189), S(0x018b), S(0x018e), S(0x018f), S(0x0190), S(0x0191), S(0x0193),
-            S(0x0194), S(0x0196), S(0x0197), S(0x0198), S(0x019c), S(0x019d), S(0x019f), R(0x01a0,0x01a4), S(0x01a6),
-            S(0x01a7), S(0x01a9), S(0x01ac), S(0x01ae), S(0x01af), S(0x01b1), S(0x01b3), S(0x01b7), S(0x01b8),
-            S(0x01bc), S(0x01c4), S(0x01c5), S(0x01c7), S(0x01c8), S(0x01ca), R(0x01cb,0x01db), R(0x01de,0x01ee),
-            S(0x01f1), S(0x01f2), S(0x01f6), S(0x01f7), R(0x01f8,0x021e), S(0x0220), R(0x0222,0x0232), S(0x023a),
-            S(0x023b), S(0x023d), S(0x023e), S(0x0241), S(0x0243), S(0x0244), S(0x0245), R(0x0246,0x024e), S(0x0345),
-            S(0x0370), S(0x0376), S(0x037f), S(0x0386), R(0x0388,0x038a), S(0x038c), S(0x038e), R(0x0391,0x03a1),
-            R(0x03a3,0x03ab), S(0x03c2), S(0x03cf), S(0x03d0), S(0x03d1), S(0x03d5), S(0x03d6), R(0x03d8,0x03ee),
-            S(0x03f0), S(0x03f1), S(0x03f4), S(0x03f5), S(0x03f7), S(0x03f9), S(0x03fa), R(0x03fd,0x03ff),
-            R(0x0400,0x040f), R(0x0410,0x042f), R(0x0460,0x0480), R(0x048a,0x04be), S(0x04c0), R(0x04c1,0x04cd),
-            R(0x04d0,0x052e), R(0x0531,0x0556), R(0x10a0,0x10c5), S(0x10c7), S(0x10cd), R(0x13f8,0x13fd), S(0x1c80),
-            S(0x1c81), S(0x1c82), S(0x1c83), S(0x1c85), S(0x1c86), S(0x1c87), S(0x1c88), R(0x1c90,0x1cba),
-            R(0x1cbd,0x1cbf), R(0x1e00,0x1e94), S(0x1e9b), R(0x1ea0,0x1efe), R(0x1f08,0x1f0f), R(0x1f18,0x1f1d),
-            R(0x1f28,0x1f2f), R(0x1f38,0x1f3f), R(0x1f48,0x1f4d), S(0x1f59), S(0x1f5b), S(0x1f5d), S(0x1f5f),
-            R(0x1f68,0x1f6f), S(0x1fb8), S(0x1fba), S(0x1fbe), R(0x1fc8,0x1fcb), S(0x1fd8), S(0x1fda), S(0x1fe8),
-            S(0x1fea), S(0x1fec), S(0x1ff8), S(0x1ffa), S(0x2126), S(0x212a), S(0x212b), S(0x2132), R(0x2160,0x216f),
-            S(0x2183), R(0x24b6,0x24cf), R(0x2c00,0x2c2e), S(0x2c60), S(0x2c62), S(0x2c63), S(0x2c64),
-            R(0x2c67,0x2c6b), S(0x2c6d), S(0x2c6e), S(0x2c6f), S(0x2c70), S(0x2c72), S(0x2c75), S(0x2c7e),
-            R(0x2c80,0x2ce2), S(0x2ceb), S(0x2cf2), R(0xa640,0xa66c), R(0xa680,0xa69a), R(0xa722,0xa72e),
-            R(0xa732,0xa76e), S(0xa779), S(0xa77d), R(0xa77e,0xa786), S(0xa78b), S(0xa78d), S(0xa790),
-            R(0xa796,0xa7a8), S(0xa7aa), S(0xa7ab), S(0xa7ac), S(0xa7ad), S(0xa7ae), S(0xa7b0), S(0xa7b1), S(0xa7b2),
-            S(0xa7b3), R(0xa7b4,0xa7be), S(0xa7c2), S(0xa7c4), S(0xa7c5), S(0xa7c6), R(0xab70,0xabbf),
-            R(0xff21,0xff3a), R(0x10400,0x10427), R(0x104b0,0x104d3), R(0x10c80,0x10cb2), R(0x118a0,0x118bf),
-            R(0x16e40,0x16e5f), R(0x1e900,0x1e921)
-        };
-        static const unsigned FOLD_MAP_1_DATA[] = {
-            0x0061, 0x007a, 0x03bc, 0x00e0, 0x00f6, 0x00f8, 0x00fe, 0x0101, 0x012f, 0x0133, 0x0137, 0x013a, 0x0148,
-            0x014b, 0x0177, 0x00ff, 0x017a, 0x017e, 0x0073, 0x0253, 0x0183, 0x0254, 0x0188, 0x0256, 0x018c, 0x01dd,
-            0x0259, 0x025b, 0x0192, 0x0260, 0x0263, 0x0269, 0x0268, 0x0199, 0x026f, 0x0272, 0x0275, 0x01a1, 0x01a5,
-            0x0280, 0x01a8, 0x0283, 0x01ad, 0x0288, 0x01b0, 0x028a, 0x01b4, 0x0292, 0x01b9, 0x01bd, 0x01c6, 0x01c6,
-            0x01c9, 0x01c9, 0x01cc, 0x01cc, 0x01dc, 0x01df, 0x01ef, 0x01f3, 0x01f3, 0x0195, 0x01bf, 0x01f9, 0x021f,
-            0x019e, 0x0223, 0x0233, 0x2c65, 0x023c, 0x019a, 0x2c66, 0x0242, 0x0180, 0x0289, 0x028c, 0x0247, 0x024f,
-            0x03b9, 0x0371, 0x0377, 0x03f3, 0x03ac, 0x03ad, 0x03af, 0x03cc, 0x03cd, 0x03b1, 0x03c1, 0x03c3, 0x03cb,
-            0x03c3, 0x03d7, 0x03b2, 0x03b8, 0x03c6, 0x03c0, 0x03d9, 0x03ef, 0x03ba, 0x03c1, 0x03b8, 0x03b5, 0x03f8,
-            0x03f2, 0x03fb, 0x037b, 0x037d, 0x0450, 0x045f, 0x0430, 0x044f, 0x0461, 0x0481, 0x048b, 0x04bf, 0x04cf,
-            0x04c2, 0x04ce, 0x04d1, 0x052f, 0x0561, 0x0586, 0x2d00, 0x2d25, 0x2d27, 0x2d2d, 0x13f0, 0x13f5, 0x0432,
-            0x0434, 0x043e, 0x0441, 0x0442, 0x044a, 0x0463, 0xa64b, 0x10d0, 0x10fa, 0x10fd, 0x10ff, 0x1e01, 0x1e95,
-            0x1e61, 0x1ea1, 0x1eff, 0x1f00, 0x1f07, 0x1f10, 0x1f15, 0x1f20, 0x1f27, 0x1f30, 0x1f37, 0x1f40, 0x1f45,
-            0x1f51, 0x1f53, 0x1f55, 0x1f57, 0x1f60, 0x1f67, 0x1fb0, 0x1f70, 0x03b9, 0x1f72, 0x1f75, 0x1fd0, 0x1f76,
-            0x1fe0, 0x1f7a, 0x1fe5, 0x1f78, 0x1f7c, 0x03c9, 0x006b, 0x00e5, 0x214e, 0x2170, 0x217f, 0x2184, 0x24d0,
-            0x24e9, 0x2c30, 0x2c5e, 0x2c61, 0x026b, 0x1d7d, 0x027d, 0x2c68, 0x2c6c, 0x0251, 0x0271, 0x0250, 0x0252,
-            0x2c73, 0x2c76, 0x023f, 0x2c81, 0x2ce3, 0x2cec, 0x2cf3, 0xa641, 0xa66d, 0xa681, 0xa69b, 0xa723, 0xa72f,
-            0xa733, 0xa76f, 0xa77a, 0x1d79, 0xa77f, 0xa787, 0xa78c, 0x0265, 0xa791, 0xa797, 0xa7a9, 0x0266, 0x025c,
-            0x0261, 0x026c, 0x026a, 0x029e, 0x0287, 0x029d, 0xab53, 0xa7b5, 0xa7bf, 0xa7c3, 0xa794, 0x0282, 0x1d8e,
-            0x13a0, 0x13ef, 0xff41, 0xff5a, 0x10428, 0x1044f, 0x104d8, 0x104fb, 0x10cc0, 0x10cf2, 0x118c0, 0x118df,
-            0x16e60, 0x16e7f, 0x1e922, 0x1e943
-        };
-        static const unsigned FOLD_MAP_2[] = {
-            S(0x00df), S(0x0130), S(0x0149), S(0x01f0), S(0x0587), S(0x1e96), S(0x1e97), S(0x1e98), S(0x1e99),
-            S(0x1e9a), S(0x1e9e), S(0x1f50), R(0x1f80,0x1f87), R(0x1f88,0x1f8f), R(0x1f90,0x1f97), R(0x1f98,0x1f9f),
-            R(0x1fa0,0x1fa7), R(0x1fa8,0x1faf), S(0x1fb2), S(0x1fb3), S(0x1fb4), S(0x1fb6), S(0x1fbc), S(0x1fc2),
-            S(0x1fc3), S(0x1fc4), S(0x1fc6), S(0x1fcc), S(0x1fd6), S(0x1fe4), S(0x1fe6), S(0x1ff2), S(0x1ff3),
-            S(0x1ff4), S(0x1ff6), S(0x1ffc), S(0xfb00), S(0xfb01), S(0xfb02), S(0xfb05), S(0xfb06), S(0xfb13),
-            S(0xfb14), S(0xfb15), S(0xfb16), S(0xfb17)
-        };
-        static const unsigned FOLD_MAP_2_DATA[] = {
-            0x0073,0x0073, 0x0069,0x0307, 0x02bc,0x006e, 0x006a,0x030c, 0x0565,0x0582, 0x0068,0x0331, 0x0074,0x0308,
-            0x0077,0x030a, 0x0079,0x030a, 0x0061,0x02be, 0x0073,0x0073, 0x03c5,0x0313, 0x1f00,0x03b9, 0x1f07,0x03b9,
-            0x1f00,0x03b9, 0x1f07,0x03b9, 0x1f20,0x03b9, 0x1f27,0x03b9, 0x1f20,0x03b9, 0x1f27,0x03b9, 0x1f60,0x03b9,
-            0x1f67,0x03b9, 0x1f60,0x03b9, 0x1f67,0x03b9, 0x1f70,0x03b9, 0x03b1,0x03b9, 0x03ac,0x03b9, 0x03b1,0x0342,
-            0x03b1,0x03b9, 0x1f74,0x03b9, 0x03b7,0x03b9, 0x03ae,0x03b9, 0x03b7,0x0342, 0x03b7,0x03b9, 0x03b9,0x0342,
-            0x03c1,0x0313, 0x03c5,0x0342, 0x1f7c,0x03b9, 0x03c9,0x03b9, 0x03ce,0x03b9, 0x03c9,0x0342, 0x03c9,0x03b9,
-            0x0066,0x0066, 0x0066,0x0069, 0x0066,0x006c, 0x0073,0x0074, 0x0073,0x0074, 0x0574,0x0576, 0x0574,0x0565,
-            0x0574,0x056b, 0x057e,0x0576, 0x0574,0x056d
-        };
-        static const unsigned FOLD_MAP_3[] = {
-            S(0x0390), S(0x03b0), S(0x1f52), S(0x1f54), S(0x1f56), S(0x1fb7), S(0x1fc7), S(0x1fd2), S(0x1fd3),
-            S(0x1fd7), S(0x1fe2), S(0x1fe3), S(0x1fe7), S(0x1ff7), S(0xfb03), S(0xfb04)
-        };
-        static const unsigned FOLD_MAP_3_DATA[] = {
-            0x03b9,0x0308,0x0301, 0x03c5,0x0308,0x0301, 0x03c5,0x0313,0x0300, 0x03c5,0x0313,0x0301,
-            0x03c5,0x0313,0x0342, 0x03b1,0x0342,0x03b9, 0x03b7,0x0342,0x03b9, 0x03b9,0x0308,0x0300,
-            0x03b9,0x0308,0x0301, 0x03b9,0x0308,0x0342, 0x03c5,0x0308,0x0300, 0x03c5,0x0308,0x0301,
-            0x03c5,0x0308,0x0342, 0x03c9,0x0342,0x03b9, 0x0066,0x0066,0x0069, 0x0066,0x0066,0x006c
-        };
-#undef R
-#undef S
-        static const struct {
-            const unsigned* map;
-            const unsigned* data;
-            size_t map_size;
-            int n_codepoints;
-        } FOLD_MAP_LIST[] = {
-            { FOLD_MAP_1, FOLD_MAP_1_DATA, SIZEOF_ARRAY(FOLD_MAP_1), 1 },
-            { FOLD_MAP_2, FOLD_MAP_2_DATA, SIZEOF_ARRAY(FOLD_MAP_2), 2 },
-            { FOLD_MAP_3, FOLD_MAP_3_DATA, SIZEOF_ARRAY(FOLD_MAP_3), 3 }
-        };
-
-        int i;
+        const MD_UNICODE_FOLD* fold;
 
         /* Fast path for ASCII characters. */
         if(codepoint <= 0x7f) {
@@ -678,39 +594,13 @@ struct MD_UNICODE_FOLD_INFO_tag {
             return;
         }
 
-        /* Try to locate the codepoint in any of the maps. */
-        for(i = 0; i < (int) SIZEOF_ARRAY(FOLD_MAP_LIST); i++) {
-            int index;
-
-            index = md_unicode_bsearch__(codepoint, FOLD_MAP_LIST[i].map, FOLD_MAP_LIST[i].map_size);
-            if(index >= 0) {
-                /* Found the mapping. */
-                int n_codepoints = FOLD_MAP_LIST[i].n_codepoints;
-                const unsigned* map = FOLD_MAP_LIST[i].map;
-                const unsigned* codepoints = FOLD_MAP_LIST[i].data + (index * n_codepoints);
-
-                memcpy(info->codepoints, codepoints, sizeof(unsigned) * n_codepoints);
-                info->n_codepoints = n_codepoints;
-
-                if(FOLD_MAP_LIST[i].map[index] != codepoint) {
-                    /* The found mapping maps whole range of codepoints,
-                     * i.e. we have to offset info->codepoints[0] accordingly. */
-                    if((map[index] & 0x00ffffff)+1 == codepoints[0]) {
-                        /* Alternating type of the range. */
-                        info->codepoints[0] = codepoint + ((codepoint & 0x1) == (map[index] & 0x1) ? 1 : 0);
-                    } else {
-                        /* Range to range kind of mapping. */
-                        info->codepoints[0] += (codepoint - (map[index] & 0x00ffffff));
-                    }
-                }
-
-                return;
-            }
+        fold = &MD_UNICODE_FOLDS[md_unicode_info__(codepoint) >> MD_UNICODE_FOLD_SHIFT];
+        if(fold->n_codepoints == 1) {
+            info->codepoints[0] = codepoint + fold->codepoints[0];
+        } else {
+            memcpy(info->codepoints, fold->codepoints, sizeof(unsigned) * fold->n_codepoints);
         }
-
-        /* No mapping found. Map the codepoint to itself. */
-        info->codepoints[0] = codepoint;
-        info->n_codepoints = 1;
+        info->n_codepoints = fold->n_codepoints;
     }
 #endif
 
@@ -750,8 +640,11 @@ struct MD_UNICODE_FOLD_INFO_tag {
     #define ISUNICODEWHITESPACE(off)        md_is_unicode_whitespace__(CH(off))
     #define ISUNICODEWHITESPACEBEFORE(off)  md_is_unicode_whitespace__(CH((off)-1))
 
-    #define ISUNICODEPUNCT(off)             md_is_unicode_punct__(md_decode_utf16le__(STR(off), ctx->size - (off), NULL))
-    #define ISUNICODEPUNCTBEFORE(off)       md_is_unicode_punct__(md_decode_utf16le_before__(ctx, off))
+    /* ASCII needs no decoding. */
+    #define ISUNICODEPUNCT(off)             (CH(off) <= 0x7f ? ISPUNCT(off) :                       \
+                                             md_is_unicode_punct__(md_decode_utf16le__(STR(off), ctx->size - (off), NULL)))
+    #define ISUNICODEPUNCTBEFORE(off)       (CH((off)-1) <= 0x7f ? ISPUNCT((off)-1) :               \
+                                             md_is_unicode_punct__(md_decode_utf16le_before__(ctx, off)))
 
     static inline int
     md_decode_unicode(const CHAR* str, OFF off, SZ str_size, SZ* p_char_size)
@@ -827,12 +720,17 @@ struct MD_UNICODE_FOLD_INFO_tag {
         return (unsigned) CH(off-1);
     }
 
+    /* ASCII needs no decoding. */
     #define ISUNICODEWHITESPACE_(codepoint) md_is_unicode_whitespace__(codepoint)
-    #define ISUNICODEWHITESPACE(off)        md_is_unicode_whitespace__(md_decode_utf8__(STR(off), ctx->size - (off), NULL))
-    #define ISUNICODEWHITESPACEBEFORE(off)  md_is_unicode_whitespace__(md_decode_utf8_before__(ctx, off))
+    #define ISUNICODEWHITESPACE(off)        (IS_UTF8_LEAD1(CH(off)) ? ISWHITESPACE(off) :           \
+                                             md_is_unicode_whitespace__(md_decode_utf8__(STR(off), ctx->size - (off), NULL)))
+    #define ISUNICODEWHITESPACEBEFORE(off)  (IS_UTF8_LEAD1(CH((off)-1)) ? ISWHITESPACE((off)-1) :   \
+                                             md_is_unicode_whitespace__(md_decode_utf8_before__(ctx, off)))
 
-    #define ISUNICODEPUNCT(off)             md_is_unicode_punct__(md_decode_utf8__(STR(off), ctx->size - (off), NULL))
-    #define ISUNICODEPUNCTBEFORE(off)       md_is_unicode_punct__(md_decode_utf8_before__(ctx, off))
+    #define ISUNICODEPUNCT(off)             (IS_UTF8_LEAD1(CH(off)) ? ISPUNCT(off) :                \
+                                             md_is_unicode_punct__(md_decode_utf8__(STR(off), ctx->size - (off), NULL)))
+    #define ISUNICODEPUNCTBEFORE(off)       (IS_UTF8_LEAD1(CH((off)-1)) ? ISPUNCT((off)-1) :        \
+                                             md_is_unicode_punct__(md_decode_utf8_before__(ctx, off)))
 
     static inline unsigned
     md_decode_unicode(const CHAR* str, OFF off, SZ str_size, SZ* p_char_size)
@@ -869,6 +767,47 @@ struct MD_UNICODE_FOLD_INFO_tag {
  ***  Helper string manipulations  ***
  *************************************/
 
+/* Returns index of the line where 'off' lies (or of the following one if it
+ * is past the end of a line). Links are mostly resolved left to right, so the
+ * search starts at the line found the last time and only falls back to a
+ * binary search when it is behind or far ahead; scanning from the first line
+ * each time made a paragraph of many links quadratic.
+ */
+static int
+md_find_line(MD_CTX* ctx, const MD_LINE* lines, int n_lines, OFF off)
+{
+    int beg = 0;
+    int end = n_lines - 1;
+    int i;
+
+    i = ctx->line_hint;
+    if(i < n_lines  &&  (i == 0  ||  lines[i-1].end <= off)) {
+        int n;
+
+        for(n = 0; n < 8  &&  i < end; n++) {
+            if(off < lines[i].end)
+                break;
+            i++;
+        }
+        if(off < lines[i].end  ||  i == end) {
+            ctx->line_hint = i;
+            return i;
+        }
+        beg = i;
+    }
+
+    while(beg < end) {
+        i = beg + (end - beg) / 2;
+        if(off < lines[i].end)
+            end = i;
+        else
+            beg = i + 1;
+    }
+
+    ctx->line_hint = beg;
+    return beg;
+}
+
 /* Fill buffer with copy of the string between 'beg' and 'end' but replace any
  * line breaks with given replacement character.
  *
@@ -917,7 +856,7 @@ md_merge_lines_alloc(MD_CTX* ctx, OFF beg, OFF end, const MD_LINE* lines, int n_
 {
     CHAR* buffer;
 
-    buffer = (CHAR*) malloc(sizeof(CHAR) * (end - beg));
+    buffer = (CHAR*) MD_MALLOC(sizeof(CHAR) * (end - beg));
     if(buffer == NULL) {
         MD_LOG("malloc() failed.");
         return -1;
@@ -1333,18 +1272,18 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
 
         build->substr_alloc = (build->substr_alloc == 0 ? 8 : build->substr_alloc * 2);
 
-        new_substr_types = (MD_TEXTTYPE*) realloc(build->substr_types,
+        new_substr_types = (MD_TEXTTYPE*) MD_REALLOC(build->substr_types,
                                     build->substr_alloc * sizeof(MD_TEXTTYPE));
         if(new_substr_types == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
         }
         /* Note +1 to reserve space for final offset (== raw_size). */
-        new_substr_offsets = (OFF*) realloc(build->substr_offsets,
+        new_substr_offsets = (OFF*) MD_REALLOC(build->substr_offsets,
                                     (build->substr_alloc+1) * sizeof(OFF));
         if(new_substr_offsets == NULL) {
             MD_LOG("realloc() failed.");
-            free(new_substr_types);
+            MD_FREE(new_substr_types);
             return -1;
         }
 
@@ -1362,9 +1301,9 @@ static void
 md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build)
 {
     if(build->substr_alloc > 0) {
-        free(build->text);
-        free(build->substr_types);
-        free(build->substr_offsets);
+        MD_FREE(build->text);
+        MD_FREE(build->substr_types);
+        MD_FREE(build->substr_offsets);
     }
 }
 
@@ -1399,7 +1338,7 @@ md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
         build->trivial_offsets[1] = raw_size;
         off = raw_size;
     } else {
-        build->text = (CHAR*) malloc(raw_size * sizeof(CHAR));
+        build->text = (CHAR*) MD_MALLOC(raw_size * sizeof(CHAR));
         if(build->text == NULL) {
             MD_LOG("malloc() failed.");
             goto abort;
@@ -1598,211 +1537,114 @@ md_link_label_cmp(const CHAR* a_label, SZ a_size, const CHAR* b_label, SZ b_size
     return 0;
 }
 
-typedef struct MD_REF_DEF_LIST_tag MD_REF_DEF_LIST;
-struct MD_REF_DEF_LIST_tag {
-    int n_ref_defs;
-    int alloc_ref_defs;
-    MD_REF_DEF* ref_defs[];  /* Valid items always  point into ctx->ref_defs[] */
+/* The reference definitions are looked up in a flat open addressing table
+ * with linear probing. Each slot keeps the hash of its definition, so that
+ * probing only compares labels when the hashes match. */
+struct MD_REF_DEF_SLOT_tag {
+    unsigned hash;
+    int index;      /* Into ctx->ref_defs[], or -1 for a free slot. */
 };
 
-static int
-md_ref_def_cmp(const void* a, const void* b)
-{
-    const MD_REF_DEF* a_ref = *(const MD_REF_DEF**)a;
-    const MD_REF_DEF* b_ref = *(const MD_REF_DEF**)b;
-
-    if(a_ref->hash < b_ref->hash)
-        return -1;
-    else if(a_ref->hash > b_ref->hash)
-        return +1;
-    else
-        return md_link_label_cmp(a_ref->label, a_ref->label_size, b_ref->label, b_ref->label_size);
-}
-
-static int
-md_ref_def_cmp_stable(const void* a, const void* b)
+/* md_link_label_hash() is FNV-1a, whose low bits depend only on the low bits
+ * of the codepoints; so mix the high ones in before masking. */
+static inline unsigned
+md_ref_def_slot(MD_CTX* ctx, unsigned hash)
 {
-    int cmp;
-
-    cmp = md_ref_def_cmp(a, b);
-
-    /* Ensure stability of the sorting. */
-    if(cmp == 0) {
-        const MD_REF_DEF* a_ref = *(const MD_REF_DEF**)a;
-        const MD_REF_DEF* b_ref = *(const MD_REF_DEF**)b;
-
-        if(a_ref < b_ref)
-            cmp = -1;
-        else if(a_ref > b_ref)
-            cmp = +1;
-        else
-            cmp = 0;
-    }
-
-    return cmp;
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash & (ctx->ref_def_hashtable_size - 1);
 }
 
 static int
 md_build_ref_def_hashtable(MD_CTX* ctx)
 {
-    int i, j;
+    int size;
+    int i;
 
     if(ctx->n_ref_defs == 0)
         return 0;
 
-    ctx->ref_def_hashtable_size = (ctx->n_ref_defs * 5) / 4;
-    ctx->ref_def_hashtable = malloc(ctx->ref_def_hashtable_size * sizeof(void*));
-    if(ctx->ref_def_hashtable == NULL) {
-        MD_LOG("malloc() failed.");
-        goto abort;
+    /* Keep the table at most half full so the probe sequences stay short. */
+    size = 16;
+    while(size < 2 * ctx->n_ref_defs)
+        size *= 2;
+
+    if(size > ctx->alloc_ref_def_hashtable) {
+        MD_REF_DEF_SLOT* new_hashtable;
+
+        new_hashtable = (MD_REF_DEF_SLOT*) MD_WORK_REALLOC(ctx->ref_def_hashtable, size * sizeof(MD_REF_DEF_SLOT));
+        if(new_hashtable == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+        ctx->ref_def_hashtable = new_hashtable;
+        ctx->alloc_ref_def_hashtable = size;
     }
-    memset(ctx->ref_def_hashtable, 0, ctx->ref_def_hashtable_size * sizeof(void*));
+    ctx->ref_def_hashtable_size = size;
+    for(i = 0; i < size; i++)
+        ctx->ref_def_hashtable[i].index = -1;
 
-    /* Each member of ctx->ref_def_hashtable[] can be:
-     *  -- NULL,
-     *  -- pointer to the MD_REF_DEF in ctx->ref_defs[], or
-     *  -- pointer to a MD_REF_DEF_LIST, which holds multiple pointers to
-     *     such MD_REF_DEFs.
-     */
+    /* Insert in the document order, so that when a label is defined more
+     * than once, the first definition is the one found. */
     for(i = 0; i < ctx->n_ref_defs; i++) {
         MD_REF_DEF* def = &ctx->ref_defs[i];
-        void* bucket;
-        MD_REF_DEF_LIST* list;
+        MD_REF_DEF_SLOT* slot;
+        unsigned k;
 
         def->hash = md_link_label_hash(def->label, def->label_size);
-        bucket = ctx->ref_def_hashtable[def->hash % ctx->ref_def_hashtable_size];
-
-        if(bucket == NULL) {
-            ctx->ref_def_hashtable[def->hash % ctx->ref_def_hashtable_size] = def;
-            continue;
-        }
-
-        if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs) {
-            /* The bucket already contains one ref. def. Lets see whether it
-             * is the same label (ref. def. duplicate) or different one
-             * (hash conflict). */
-            MD_REF_DEF* old_def = (MD_REF_DEF*) bucket;
-
-            if(md_link_label_cmp(def->label, def->label_size, old_def->label, old_def->label_size) == 0) {
-                /* Ignore this ref. def. */
-                continue;
-            }
-
-            /* Make the bucket capable of holding more ref. defs. */
-            list = (MD_REF_DEF_LIST*) malloc(sizeof(MD_REF_DEF_LIST) + 4 * sizeof(MD_REF_DEF*));
-            if(list == NULL) {
-                MD_LOG("malloc() failed.");
-                goto abort;
-            }
-            list->ref_defs[0] = old_def;
-            list->ref_defs[1] = def;
-            list->n_ref_defs = 2;
-            list->alloc_ref_defs = 4;
-            ctx->ref_def_hashtable[def->hash % ctx->ref_def_hashtable_size] = list;
-            continue;
-        }
-
-        /* Append the def to the bucket list. */
-        list = (MD_REF_DEF_LIST*) bucket;
-        if(list->n_ref_defs >= list->alloc_ref_defs) {
-            MD_REF_DEF_LIST* list_tmp = (MD_REF_DEF_LIST*) realloc(list,
-                        sizeof(MD_REF_DEF_LIST) + 2 * list->alloc_ref_defs * sizeof(MD_REF_DEF*));
-            if(list_tmp == NULL) {
-                MD_LOG("realloc() failed.");
-                goto abort;
+        k = md_ref_def_slot(ctx, def->hash);
+        while(1) {
+            slot = &ctx->ref_def_hashtable[k];
+            if(slot->index < 0)
+                break;
+            if(slot->hash == def->hash) {
+                const MD_REF_DEF* old_def = &ctx->ref_defs[slot->index];
+                if(md_link_label_cmp(def->label, def->label_size, old_def->label, old_def->label_size) == 0)
+                    break;
             }
-            list = list_tmp;
-            list->alloc_ref_defs *= 2;
-            ctx->ref_def_hashtable[def->hash % ctx->ref_def_hashtable_size] = list;
+            k = (k + 1) & (size - 1);
         }
 
-        list->ref_defs[list->n_ref_defs] = def;
-        list->n_ref_defs++;
-    }
-
-    /* Sort the complex buckets so we can use bsearch() with them. */
-    for(i = 0; i < ctx->ref_def_hashtable_size; i++) {
-        void* bucket = ctx->ref_def_hashtable[i];
-        MD_REF_DEF_LIST* list;
-
-        if(bucket == NULL)
-            continue;
-        if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs)
-            continue;
-
-        list = (MD_REF_DEF_LIST*) bucket;
-        qsort(list->ref_defs, list->n_ref_defs, sizeof(MD_REF_DEF*), md_ref_def_cmp_stable);
-
-        /* Disable duplicates. */
-        for(j = 1; j < list->n_ref_defs; j++) {
-            if(md_ref_def_cmp(&list->ref_defs[j-1], &list->ref_defs[j]) == 0)
-                list->ref_defs[j] = list->ref_defs[j-1];
+        if(slot->index < 0) {
+            slot->hash = def->hash;
+            slot->index = i;
         }
     }
 
     return 0;
-
-abort:
-    return -1;
 }
 
+/* The table itself is kept for the next document. */
 static void
 md_free_ref_def_hashtable(MD_CTX* ctx)
 {
-    if(ctx->ref_def_hashtable != NULL) {
-        int i;
-
-        for(i = 0; i < ctx->ref_def_hashtable_size; i++) {
-            void* bucket = ctx->ref_def_hashtable[i];
-            if(bucket == NULL)
-                continue;
-            if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs)
-                continue;
-            free(bucket);
-        }
-
-        free(ctx->ref_def_hashtable);
-    }
+    ctx->ref_def_hashtable_size = 0;
 }
 
 static const MD_REF_DEF*
 md_lookup_ref_def(MD_CTX* ctx, const CHAR* label, SZ label_size)
 {
     unsigned hash;
-    void* bucket;
+    unsigned k;
 
     if(ctx->ref_def_hashtable_size == 0)
         return NULL;
 
     hash = md_link_label_hash(label, label_size);
-    bucket = ctx->ref_def_hashtable[hash % ctx->ref_def_hashtable_size];
-
-    if(bucket == NULL) {
-        return NULL;
-    } else if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs) {
-        const MD_REF_DEF* def = (MD_REF_DEF*) bucket;
-
-        if(md_link_label_cmp(def->label, def->label_size, label, label_size) == 0)
-            return def;
-        else
-            return NULL;
-    } else {
-        MD_REF_DEF_LIST* list = (MD_REF_DEF_LIST*) bucket;
-        MD_REF_DEF key_buf;
-        const MD_REF_DEF* key = &key_buf;
-        const MD_REF_DEF** ret;
-
-        key_buf.label = (CHAR*) label;
-        key_buf.label_size = label_size;
-        key_buf.hash = md_link_label_hash(key_buf.label, key_buf.label_size);
-
-        ret = (const MD_REF_DEF**) bsearch(&key, list->ref_defs,
-                    list->n_ref_defs, sizeof(MD_REF_DEF*), md_ref_def_cmp);
-        if(ret != NULL)
-            return *ret;
-        else
-            return NULL;
+    k = md_ref_def_slot(ctx, hash);
+    while(ctx->ref_def_hashtable[k].index >= 0) {
+        const MD_REF_DEF_SLOT* slot = &ctx->ref_def_hashtable[k];
+
+        if(slot->hash == hash) {
+            const MD_REF_DEF* def = &ctx->ref_defs[slot->index];
+            if(md_link_label_cmp(def->label, def->label_size, label, label_size) == 0)
+                return def;
+        }
+        k = (k + 1) & (ctx->ref_def_hashtable_size - 1);
     }
+
+    return NULL;
 }
 
 
@@ -2138,7 +1980,7 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
         MD_REF_DEF* new_defs;
 
         ctx->alloc_ref_defs = (ctx->alloc_ref_defs > 0 ? ctx->alloc_ref_defs * 2 : 16);
-        new_defs = (MD_REF_DEF*) realloc(ctx->ref_defs, ctx->alloc_ref_defs * sizeof(MD_REF_DEF));
+        new_defs = (MD_REF_DEF*) MD_WORK_REALLOC(ctx->ref_defs, ctx->alloc_ref_defs * sizeof(MD_REF_DEF));
         if(new_defs == NULL) {
             MD_LOG("realloc() failed.");
             ret = -1;
@@ -2178,7 +2020,7 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
 abort:
     /* Failure. */
     if(label_needs_free)
-        free(label);
+        MD_FREE(label);
     return -1;
 }
 
@@ -2199,11 +2041,10 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, int n_lines,
     beg += (CH(beg) == _T('!') ? 2 : 1);
     end--;
 
-    /* Find lines corresponding to the beg and end positions. */
+    /* Find lines corresponding to the beg and end positions. (The label is
+     * at most 999 characters long, so the latter is near.) */
     MD_ASSERT(lines[0].beg <= beg);
-    beg_line = lines;
-    while(beg >= beg_line->end)
-        beg_line++;
+    beg_line = lines + md_find_line(ctx, lines, n_lines, beg);
 
     MD_ASSERT(end <= lines[n_lines-1].end);
     end_line = beg_line;
@@ -2228,7 +2069,7 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, int n_lines,
     }
 
     if(beg_line != end_line)
-        free(label);
+        MD_FREE(label);
 
     ret = (def != NULL);
 
@@ -2240,7 +2081,7 @@ static int
 md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, int n_lines,
                        OFF beg, OFF* p_end, MD_LINK_ATTR* attr)
 {
-    int line_index = 0;
+    int line_index;
     int tmp_line_index;
     OFF title_contents_beg;
     OFF title_contents_end;
@@ -2249,8 +2090,7 @@ md_is_inline_link_spec(MD_CTX* ctx, const MD_LINE* lines, int n_lines,
     OFF off = beg;
     int ret = FALSE;
 
-    while(off >= lines[line_index].end)
-        line_index++;
+    line_index = md_find_line(ctx, lines, n_lines, off);
 
     MD_ASSERT(CH(off) == _T('('));
     off++;
@@ -2333,6 +2173,7 @@ abort:
     return ret;
 }
 
+/* Frees what the ref. defs own; the array itself is kept for the next document. */
 static void
 md_free_ref_defs(MD_CTX* ctx)
 {
@@ -2342,13 +2183,12 @@ md_free_ref_defs(MD_CTX* ctx)
         MD_REF_DEF* def = &ctx->ref_defs[i];
 		if (def) {
 			if (def->label_needs_free)
-				free(def->label);
+				MD_FREE(def->label);
 			if (def->title_needs_free)
-				free(def->title);
+				MD_FREE(def->title);
 		}
     }
-
-    free(ctx->ref_defs);
+    ctx->n_ref_defs = 0;
 }
 
 
@@ -2487,7 +2327,7 @@ md_push_mark(MD_CTX* ctx)
         MD_MARK* new_marks;
 
         ctx->alloc_marks = (ctx->alloc_marks > 0 ? ctx->alloc_marks * 2 : 64);
-        new_marks = realloc(ctx->marks, ctx->alloc_marks * sizeof(MD_MARK));
+        new_marks = MD_WORK_REALLOC(ctx->marks, ctx->alloc_marks * sizeof(MD_MARK));
         if(new_marks == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
@@ -2712,6 +2552,129 @@ md_build_mark_char_map(MD_CTX* ctx)
     }
 }
 
+#ifdef MD4C_USE_UTF16
+    /* For UTF-16, mark_char_map[] covers only ASCII. */
+    #define IS_MARK_CHAR(off)   ((CH(off) < SIZEOF_ARRAY(ctx->mark_char_map))  &&  \
+                                (ctx->mark_char_map[(unsigned char) CH(off)]))
+#else
+    /* For 8-bit encodings, mark_char_map[] covers all 256 elements. */
+    #define IS_MARK_CHAR(off)   (ctx->mark_char_map[(unsigned char) CH(off)])
+#endif
+
+/* Returns offset of the first mark character in [off, end), or end if there
+ * is none. This is where most of the time goes on long runs of plain text,
+ * so it comes in several flavors picked by md_build_mark_scanner(). */
+static OFF
+md_skip_non_marks(MD_CTX* ctx, OFF off, OFF end)
+{
+    /* Optimization: Use some loop unrolling. */
+    while(off + 3 < end  &&  !IS_MARK_CHAR(off+0)  &&  !IS_MARK_CHAR(off+1)
+                         &&  !IS_MARK_CHAR(off+2)  &&  !IS_MARK_CHAR(off+3))
+        off += 4;
+    while(off < end  &&  !IS_MARK_CHAR(off+0))
+        off++;
+    return off;
+}
+
+#ifdef MD_SIMD
+#ifdef _MSC_VER
+static inline unsigned
+md_first_bit(unsigned mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+}
+#else
+    #define md_first_bit(mask)      ((unsigned) __builtin_ctz(mask))
+#endif
+
+/* The vectorized scanners classify a byte by its two nibbles: mark_nibble_map[]
+ * holds, for each low nibble, a bit for each high nibble completing a mark
+ * character, and md_high_nibble_bits[] maps the high nibble to that bit. All
+ * mark characters are ASCII, so high nibbles 8 to 15 map to nothing.
+ *
+ * With two table lookups (PSHUFB on x86, TBL on ARM) and an AND this tests
+ * a whole vector against any set of marks at a fixed cost. */
+static const unsigned char md_high_nibble_bits[16] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0
+};
+#endif
+
+#ifdef MD_SIMD_X86
+#if defined __GNUC__  ||  defined __clang__
+    #define MD_TARGET(isa)      __attribute__((target(isa)))
+#else
+    #define MD_TARGET(isa)
+#endif
+
+MD_TARGET("ssse3") static OFF
+md_skip_non_marks_ssse3(MD_CTX* ctx, OFF off, OFF end)
+{
+    __m128i lo_map, hi_map, low4;
+
+    if(off + 16 > end)
+        return md_skip_non_marks(ctx, off, end);
+
+    lo_map = _mm_loadu_si128((const __m128i*) ctx->mark_nibble_map);
+    hi_map = _mm_loadu_si128((const __m128i*) md_high_nibble_bits);
+    low4 = _mm_set1_epi8(0x0f);
+
+    while(off + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (ctx->text + off));
+        __m128i lo = _mm_shuffle_epi8(lo_map, _mm_and_si128(v, low4));
+        __m128i hi = _mm_shuffle_epi8(hi_map, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+        unsigned mask;
+
+        mask = ~(unsigned) _mm_movemask_epi8(
+                    _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) & 0xffff;
+        if(mask != 0)
+            return off + md_first_bit(mask);
+        off += 16;
+    }
+
+    return md_skip_non_marks(ctx, off, end);
+}
+
+static int
+md_cpu_has_ssse3(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & 0x200) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif  /* MD_SIMD_X86 */
+
+/* Picks the fastest scanner the CPU supports for the mark characters in
+ * mark_char_map[], which must be built already. */
+static void
+md_build_mark_scanner(MD_CTX* ctx)
+{
+    ctx->skip_non_marks = md_skip_non_marks;
+
+#ifdef MD_SIMD
+    {
+        int ch;
+
+        memset(ctx->mark_nibble_map, 0, sizeof(ctx->mark_nibble_map));
+        for(ch = 0; ch < 128; ch++) {
+            if(ctx->mark_char_map[ch])
+                ctx->mark_nibble_map[ch & 0x0f] |= md_high_nibble_bits[ch >> 4];
+        }
+    }
+#endif
+
+#ifdef MD_SIMD_X86
+    if(md_cpu_has_ssse3())
+        ctx->skip_non_marks = md_skip_non_marks_ssse3;
+#endif
+}
+
 /* We limit code span marks to lower then 32 backticks. This solves the
  * pathologic case of too many openers, each of different length: Their
  * resolving would be then O(n^2). */
@@ -2958,21 +2921,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, int n_lines, int table_mode)
         while(TRUE) {
             CHAR ch;
 
-#ifdef MD4C_USE_UTF16
-    /* For UTF-16, mark_char_map[] covers only ASCII. */
-    #define IS_MARK_CHAR(off)   ((CH(off) < SIZEOF_ARRAY(ctx->mark_char_map))  &&  \
-                                (ctx->mark_char_map[(unsigned char) CH(off)]))
-#else
-    /* For 8-bit encodings, mark_char_map[] covers all 256 elements. */
-    #define IS_MARK_CHAR(off)   (ctx->mark_char_map[(unsigned char) CH(off)])
-#endif
-
-            /* Optimization: Use some loop unrolling. */
-            while(off + 3 < line_end  &&  !IS_MARK_CHAR(off+0)  &&  !IS_MARK_CHAR(off+1)
-                                      &&  !IS_MARK_CHAR(off+2)  &&  !IS_MARK_CHAR(off+3))
-                off += 4;
-            while(off < line_end  &&  !IS_MARK_CHAR(off+0))
-                off++;
+            off = ctx->skip_non_marks(ctx, off, line_end);
 
             if(off >= line_end)
                 break;
@@ -3526,7 +3475,7 @@ md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
                             if(ctx->marks[mark->next].beg >= inline_link_end) {
                                 /* Cancel the link status. */
                                 if(attr.title_needs_free)
-                                    free(attr.title);
+                                    MD_FREE(attr.title);
                                 is_link = FALSE;
                                 break;
                             }
@@ -3775,7 +3724,7 @@ md_analyze_permissive_url_autolink(MD_CTX* ctx, int mark_index)
     MD_MARK* opener = &ctx->marks[mark_index];
     int closer_index = mark_index + 1;
     MD_MARK* closer = &ctx->marks[closer_index];
-    MD_MARK* next_resolved_mark;
+    MD_MARK* next_mark;
     OFF off = opener->end;
     int n_dots = FALSE;
     int has_underscore_in_last_seg = FALSE;
@@ -3807,11 +3756,18 @@ md_analyze_permissive_url_autolink(MD_CTX* ctx, int mark_index)
     if(off <= opener->end || n_dots == 0 || has_underscore_in_next_to_last_seg || has_underscore_in_last_seg)
         return;
 
-    /* Check for path. */
-    next_resolved_mark = closer + 1;
-    while(next_resolved_mark->ch == 'D' || !(next_resolved_mark->flags & MD_MARK_RESOLVED))
-        next_resolved_mark++;
-    while(off < next_resolved_mark->beg  &&  CH(off) != _T('<')  &&  !ISWHITESPACE(off)  &&  !ISNEWLINE(off)) {
+    /* Check for path. It must not run into a mark resolved already. The marks
+     * are walked along with 'off' rather than ahead of it: with many autolinks
+     * in a block, all the marks up to the next resolved one could be those of
+     * the others, still unresolved, and skipping all of them for each one made
+     * it quadratic. (The dummy mark at the end is resolved.) */
+    next_mark = closer + 1;
+    while(1) {
+        while(next_mark->ch == 'D'  ||  (next_mark->beg <= off  &&  !(next_mark->flags & MD_MARK_RESOLVED)))
+            next_mark++;
+        if(off >= next_mark->beg  ||  CH(off) == _T('<')  ||  ISWHITESPACE(off)  ||  ISNEWLINE(off))
+            break;
+
         /* Parenthesis must be balanced. */
         if(CH(off) == _T('(')) {
             n_opened_parenthesis++;
@@ -3945,6 +3901,7 @@ md_analyze_inlines(MD_CTX* ctx, const MD_LINE* lines, int n_lines, int table_mod
 
     /* Collect all marks. */
     MD_CHECK(md_collect_marks(ctx, lines, n_lines, table_mode));
+    MD_SPEND(ctx->n_marks);
 
     /* We analyze marks in few groups to handle their precedence. */
     /* (1) Entities; code spans; autolinks; raw HTML. */
@@ -4385,7 +4342,7 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
                      const MD_ALIGN* align, int col_count)
 {
     MD_LINE line;
-    OFF* pipe_offs = NULL;
+    OFF* pipe_offs;
     int i, j, k, n;
     int ret = 0;
 
@@ -4399,12 +4356,17 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     /* We have to remember the cell boundaries in local buffer because
      * ctx->marks[] shall be reused during cell contents processing. */
     n = ctx->n_table_cell_boundaries + 2;
-    pipe_offs = (OFF*) malloc(n * sizeof(OFF));
-    if(pipe_offs == NULL) {
-        MD_LOG("malloc() failed.");
-        ret = -1;
-        goto abort;
+    if(n > ctx->alloc_table_pipe_offs) {
+        pipe_offs = (OFF*) MD_WORK_REALLOC(ctx->table_pipe_offs, n * sizeof(OFF));
+        if(pipe_offs == NULL) {
+            MD_LOG("realloc() failed.");
+            ret = -1;
+            goto abort;
+        }
+        ctx->table_pipe_offs = pipe_offs;
+        ctx->alloc_table_pipe_offs = n;
     }
+    pipe_offs = ctx->table_pipe_offs;
     j = 0;
     pipe_offs[j++] = beg;
     for(i = TABLECELLBOUNDARIES.head; i >= 0; i = ctx->marks[i].next) {
@@ -4427,11 +4389,9 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     MD_LEAVE_BLOCK(MD_BLOCK_TR, NULL);
 
 abort:
-    free(pipe_offs);
-
     /* Free any temporary memory blocks stored within some dummy marks. */
     for(i = PTR_CHAIN.head; i >= 0; i = ctx->marks[i].next)
-        free(md_mark_get_ptr(ctx, i));
+        MD_FREE(md_mark_get_ptr(ctx, i));
     PTR_CHAIN.head = -1;
     PTR_CHAIN.tail = -1;
 
@@ -4449,12 +4409,17 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
      * with the underlines. */
     MD_ASSERT(n_lines >= 2);
 
-    align = malloc(col_count * sizeof(MD_ALIGN));
-    if(align == NULL) {
-        MD_LOG("malloc() failed.");
-        ret = -1;
-        goto abort;
+    if(col_count > ctx->alloc_table_align) {
+        align = (MD_ALIGN*) MD_WORK_REALLOC(ctx->table_align, col_count * sizeof(MD_ALIGN));
+        if(align == NULL) {
+            MD_LOG("realloc() failed.");
+            ret = -1;
+            goto abort;
+        }
+        ctx->table_align = align;
+        ctx->alloc_table_align = col_count;
     }
+    align = ctx->table_align;
 
     md_analyze_table_alignment(ctx, lines[1].beg, lines[1].end, align, col_count);
 
@@ -4471,7 +4436,6 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
     MD_LEAVE_BLOCK(MD_BLOCK_TBODY, NULL);
 
 abort:
-    free(align);
     return ret;
 }
 
@@ -4528,7 +4492,7 @@ md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, int n_lines)
 abort:
     /* Free any temporary memory blocks stored within some dummy marks. */
     for(i = PTR_CHAIN.head; i >= 0; i = ctx->marks[i].next)
-        free(md_mark_get_ptr(ctx, i));
+        MD_FREE(md_mark_get_ptr(ctx, i));
     PTR_CHAIN.head = -1;
     PTR_CHAIN.tail = -1;
 
@@ -4731,6 +4695,8 @@ md_process_all_blocks(MD_CTX* ctx)
             MD_BLOCK_LI_DETAIL li;
         } det;
 
+        MD_SPEND(1);
+
         switch(block->type) {
             case MD_BLOCK_UL:
                 det.ul.is_tight = (block->flags & MD_BLOCK_LOOSE_LIST) ? FALSE : TRUE;
@@ -4808,7 +4774,7 @@ md_push_block_bytes(MD_CTX* ctx, int n_bytes)
         void* new_block_bytes;
 
         ctx->alloc_block_bytes = (ctx->alloc_block_bytes > 0 ? ctx->alloc_block_bytes * 2 : 512);
-        new_block_bytes = realloc(ctx->block_bytes, ctx->alloc_block_bytes);
+        new_block_bytes = MD_WORK_REALLOC(ctx->block_bytes, ctx->alloc_block_bytes);
         if(new_block_bytes == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
@@ -5446,7 +5412,7 @@ md_push_container(MD_CTX* ctx, const MD_CONTAINER* container)
         MD_CONTAINER* new_containers;
 
         ctx->alloc_containers = (ctx->alloc_containers > 0 ? ctx->alloc_containers * 2 : 16);
-        new_containers = realloc(ctx->containers, ctx->alloc_containers * sizeof(MD_CONTAINER));
+        new_containers = MD_WORK_REALLOC(ctx->containers, ctx->alloc_containers * sizeof(MD_CONTAINER));
         if(new_containers == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
@@ -6182,10 +6148,13 @@ md_process_doc(MD_CTX *ctx)
     MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
 
     while(off < ctx->size) {
+        OFF line_beg = off;
+
         if(line == pivot_line)
             line = (line == &line_buf[0] ? &line_buf[1] : &line_buf[0]);
 
         MD_CHECK(md_analyze_line(ctx, off, &off, pivot_line, line));
+        MD_SPEND(off - line_beg);
         MD_CHECK(md_process_line(ctx, &pivot_line, line));
     }
 
@@ -6231,9 +6200,135 @@ abort:
  ***  Public API  ***
  ********************/
 
+static void*
+md_default_alloc(size_t size, void* userdata)
+{
+    return malloc(size);
+}
+
+static void*
+md_default_resize(void* ptr, size_t size, void* userdata)
+{
+    return realloc(ptr, size);
+}
+
+static void
+md_default_release(void* ptr, void* userdata)
+{
+    free(ptr);
+}
+
+static const MD_ALLOCATOR md_default_allocator = {
+    md_default_alloc, md_default_resize, md_default_release, NULL
+};
+
+/* The working memory of MD_CTX which outlives a document when parsing
+ * with a MD_PARSER_CTX. */
+struct MD_PARSER_CTX_tag {
+    MD_SIZE keep_size;
+    const MD_ALLOCATOR* allocator;      /* The one the memory below comes from. */
+
+    CHAR* buffer;
+    unsigned alloc_buffer;
+    MD_REF_DEF* ref_defs;
+    int alloc_ref_defs;
+    MD_REF_DEF_SLOT* ref_def_hashtable;
+    int alloc_ref_def_hashtable;
+    MD_MARK* marks;
+    int alloc_marks;
+    MD_ALIGN* table_align;
+    int alloc_table_align;
+    OFF* table_pipe_offs;
+    int alloc_table_pipe_offs;
+    void* block_bytes;
+    int alloc_block_bytes;
+    MD_CONTAINER* containers;
+    int alloc_containers;
+};
+
+/* Default of MD_PARSER_CTX::keep_size. */
+#define MD_PARSER_CTX_KEEP_SIZE     (1024 * 1024)
+
+/* Moves working memory between the long-lived context and the one of a
+ * single md_parse_ctx() call. */
+#define MD_WORKING_MEMORY(to, from)                                         \
+    do {                                                                    \
+        (to)->buffer = (from)->buffer;                                      \
+        (to)->alloc_buffer = (from)->alloc_buffer;                          \
+        (to)->ref_defs = (from)->ref_defs;                                  \
+        (to)->alloc_ref_defs = (from)->alloc_ref_defs;                      \
+        (to)->ref_def_hashtable = (from)->ref_def_hashtable;                \
+        (to)->alloc_ref_def_hashtable = (from)->alloc_ref_def_hashtable;    \
+        (to)->marks = (from)->marks;                                        \
+        (to)->alloc_marks = (from)->alloc_marks;                            \
+        (to)->table_align = (from)->table_align;                            \
+        (to)->alloc_table_align = (from)->alloc_table_align;                \
+        (to)->table_pipe_offs = (from)->table_pipe_offs;                    \
+        (to)->alloc_table_pipe_offs = (from)->alloc_table_pipe_offs;        \
+        (to)->block_bytes = (from)->block_bytes;                            \
+        (to)->alloc_block_bytes = (from)->alloc_block_bytes;                \
+        (to)->containers = (from)->containers;                              \
+        (to)->alloc_containers = (from)->alloc_containers;                  \
+    } while(0)
+
+/* Frees each buffer bigger than keep_size bytes; all of them if it is 0. */
+static void
+md_trim_working_memory(MD_PARSER_CTX* pctx, MD_SIZE keep_size)
+{
+#define MD_TRIM(ptr, alloc, item_size)                                      \
+        do {                                                                \
+            if(keep_size == 0  ||  (MD_SIZE) (alloc) * (item_size) > keep_size) { \
+                pctx->allocator->release((ptr), pctx->allocator->userdata); \
+                (ptr) = NULL;                                               \
+                (alloc) = 0;                                                \
+            }                                                               \
+        } while(0)
+
+    MD_TRIM(pctx->buffer, pctx->alloc_buffer, sizeof(CHAR));
+    MD_TRIM(pctx->ref_defs, pctx->alloc_ref_defs, sizeof(MD_REF_DEF));
+    MD_TRIM(pctx->ref_def_hashtable, pctx->alloc_ref_def_hashtable, sizeof(MD_REF_DEF_SLOT));
+    MD_TRIM(pctx->marks, pctx->alloc_marks, sizeof(MD_MARK));
+    MD_TRIM(pctx->table_align, pctx->alloc_table_align, sizeof(MD_ALIGN));
+    MD_TRIM(pctx->table_pipe_offs, pctx->alloc_table_pipe_offs, sizeof(OFF));
+    MD_TRIM(pctx->block_bytes, pctx->alloc_block_bytes, 1);
+    MD_TRIM(pctx->containers, pctx->alloc_containers, sizeof(MD_CONTAINER));
+
+#undef MD_TRIM
+}
+
+MD_PARSER_CTX*
+md_parser_ctx_new(MD_SIZE keep_size)
+{
+    MD_PARSER_CTX* pctx;
+
+    pctx = (MD_PARSER_CTX*) malloc(sizeof(MD_PARSER_CTX));
+    if(pctx == NULL)
+        return NULL;
+    memset(pctx, 0, sizeof(MD_PARSER_CTX));
+    pctx->keep_size = (keep_size > 0) ? keep_size : MD_PARSER_CTX_KEEP_SIZE;
+    pctx->allocator = &md_default_allocator;
+    return pctx;
+}
+
+void
+md_parser_ctx_trim(MD_PARSER_CTX* pctx)
+{
+    md_trim_working_memory(pctx, 0);
+}
+
+void
+md_parser_ctx_free(MD_PARSER_CTX* pctx)
+{
+    if(pctx != NULL) {
+        md_trim_working_memory(pctx, 0);
+        free(pctx);
+    }
+}
+
 int
-md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
+md_parse_ctx(MD_PARSER_CTX* pctx, const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
 {
+    MD_PARSER_CTX local_pctx;
     MD_CTX ctx;
     int i;
     int ret;
@@ -6244,14 +6339,27 @@ md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userd
         return -1;
     }
 
+    /* Without a context of the caller's, all the memory goes away at the end
+     * and so it may as well come from the caller's allocator. */
+    if(pctx == NULL) {
+        memset(&local_pctx, 0, sizeof(MD_PARSER_CTX));
+        local_pctx.allocator = (parser->allocator != NULL) ? parser->allocator : &md_default_allocator;
+        pctx = &local_pctx;
+    }
+
     /* Setup context structure. */
     memset(&ctx, 0, sizeof(MD_CTX));
+    MD_WORKING_MEMORY(&ctx, pctx);
+    ctx.alloc = (parser->allocator != NULL) ? parser->allocator : &md_default_allocator;
+    ctx.work_alloc = pctx->allocator;
     ctx.text = text;
     ctx.size = size;
     memcpy(&ctx.parser, parser, sizeof(MD_PARSER));
+    ctx.budget = parser->budget;
     ctx.userdata = userdata;
     ctx.code_indent_offset = (ctx.parser.flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (OFF)(-1) : 4;
     md_build_mark_char_map(&ctx);
+    md_build_mark_scanner(&ctx);
     ctx.doc_ends_with_newline = (size > 0  &&  ISNEWLINE_(text[size-1]));
 
     /* Reset all unresolved opener mark chains. */
@@ -6266,12 +6374,195 @@ md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userd
     ret = md_process_doc(&ctx);
 
     /* Clean-up. */
-    md_free_ref_defs(&ctx);
     md_free_ref_def_hashtable(&ctx);
-    free(ctx.buffer);
-    free(ctx.marks);
-    free(ctx.block_bytes);
-    free(ctx.containers);
+    md_free_ref_defs(&ctx);
+    MD_WORKING_MEMORY(pctx, &ctx);
+    md_trim_working_memory(pctx, pctx->keep_size);
 
     return ret;
 }
+
+int
+md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
+{
+    return md_parse_ctx(NULL, text, size, parser, userdata);
+}
+
+
+/* Each block is preceded by its size, so that growing it knows how much
+ * to copy. */
+#define MD_ARENA_ALIGN              16
+#define MD_ARENA_ROUND(sz)          (((sz) + MD_ARENA_ALIGN - 1) & ~(size_t) (MD_ARENA_ALIGN - 1))
+#define MD_ARENA_BLOCK_SIZE(ptr)    (*(size_t*) ((char*) (ptr) - MD_ARENA_ALIGN))
+
+/* Default of MD_ARENA::chunk_size. */
+#define MD_ARENA_CHUNK_SIZE         (64 * 1024)
+
+/* md_arena_reset() merges the chunks into one no bigger than this (or than
+ * MD_ARENA::chunk_size), so that one huge document does not pin its memory
+ * for good. */
+#define MD_ARENA_KEEP_SIZE          (1024 * 1024)
+
+typedef struct MD_ARENA_CHUNK_tag MD_ARENA_CHUNK;
+struct MD_ARENA_CHUNK_tag {
+    MD_ARENA_CHUNK* next;       /* The chunk filled before this one. */
+    size_t size;
+    size_t used;
+};
+
+#define MD_ARENA_CHUNK_DATA(chunk)  ((char*) (chunk) + MD_ARENA_ROUND(sizeof(MD_ARENA_CHUNK)))
+
+struct MD_ARENA_tag {
+    MD_ALLOCATOR allocator;
+    MD_ARENA_CHUNK* chunk;      /* The one being filled. */
+    size_t chunk_size;
+    size_t total_size;          /* Of all the chunks. */
+    char* last;                 /* The last block, if not freed yet: it may grow or shrink in place. */
+};
+
+static int
+md_arena_add_chunk(MD_ARENA* arena, size_t min_size)
+{
+    MD_ARENA_CHUNK* chunk;
+    size_t size = (min_size > arena->chunk_size) ? min_size : arena->chunk_size;
+
+    chunk = (MD_ARENA_CHUNK*) malloc(MD_ARENA_ROUND(sizeof(MD_ARENA_CHUNK)) + size);
+    if(chunk == NULL)
+        return -1;
+    chunk->next = arena->chunk;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->chunk = chunk;
+    arena->total_size += size;
+    arena->last = NULL;
+    return 0;
+}
+
+static void*
+md_arena_alloc(size_t size, void* userdata)
+{
+    MD_ARENA* arena = (MD_ARENA*) userdata;
+    size_t need;
+    char* block;
+
+    if(size > ((size_t) -1) / 2)
+        return NULL;
+    need = MD_ARENA_ALIGN + MD_ARENA_ROUND(size);
+
+    if(arena->chunk == NULL  ||  arena->chunk->size - arena->chunk->used < need) {
+        if(md_arena_add_chunk(arena, need) != 0)
+            return NULL;
+    }
+
+    block = MD_ARENA_CHUNK_DATA(arena->chunk) + arena->chunk->used;
+    arena->chunk->used += need;
+    arena->last = block + MD_ARENA_ALIGN;
+    MD_ARENA_BLOCK_SIZE(arena->last) = size;
+    return arena->last;
+}
+
+static void*
+md_arena_resize(void* ptr, size_t size, void* userdata)
+{
+    MD_ARENA* arena = (MD_ARENA*) userdata;
+    void* new_ptr;
+
+    if(ptr == NULL)
+        return md_arena_alloc(size, userdata);
+
+    /* The last block may just take more (or less) of its chunk. */
+    if((char*) ptr == arena->last  &&  size <= ((size_t) -1) / 2) {
+        size_t off = (char*) ptr - MD_ARENA_CHUNK_DATA(arena->chunk);
+
+        if(arena->chunk->size - off >= MD_ARENA_ROUND(size)) {
+            arena->chunk->used = off + MD_ARENA_ROUND(size);
+            MD_ARENA_BLOCK_SIZE(ptr) = size;
+            return ptr;
+        }
+    }
+
+    if(size <= MD_ARENA_BLOCK_SIZE(ptr))
+        return ptr;
+
+    new_ptr = md_arena_alloc(size, userdata);
+    if(new_ptr != NULL)
+        memcpy(new_ptr, ptr, MD_ARENA_BLOCK_SIZE(ptr));
+    return new_ptr;
+}
+
+static void
+md_arena_release(void* ptr, void* userdata)
+{
+    MD_ARENA* arena = (MD_ARENA*) userdata;
+
+    /* Anything but the last block waits for md_arena_reset(). */
+    if(ptr != NULL  &&  (char*) ptr == arena->last) {
+        arena->chunk->used = (char*) ptr - MD_ARENA_ALIGN - MD_ARENA_CHUNK_DATA(arena->chunk);
+        arena->last = NULL;
+    }
+}
+
+static void
+md_arena_free_chunks(MD_ARENA* arena)
+{
+    while(arena->chunk != NULL) {
+        MD_ARENA_CHUNK* next = arena->chunk->next;
+        free(arena->chunk);
+        arena->chunk = next;
+    }
+    arena->total_size = 0;
+    arena->last = NULL;
+}
+
+MD_ARENA*
+md_arena_new(size_t chunk_size)
+{
+    MD_ARENA* arena;
+
+    arena = (MD_ARENA*) malloc(sizeof(MD_ARENA));
+    if(arena == NULL)
+        return NULL;
+    memset(arena, 0, sizeof(MD_ARENA));
+    arena->allocator.alloc = md_arena_alloc;
+    arena->allocator.resize = md_arena_resize;
+    arena->allocator.release = md_arena_release;
+    arena->allocator.userdata = arena;
+    arena->chunk_size = (chunk_size > 0) ? chunk_size : MD_ARENA_CHUNK_SIZE;
+    return arena;
+}
+
+void
+md_arena_free(MD_ARENA* arena)
+{
+    if(arena != NULL) {
+        md_arena_free_chunks(arena);
+        free(arena);
+    }
+}
+
+void
+md_arena_reset(MD_ARENA* arena)
+{
+    size_t total_size = arena->total_size;
+
+    arena->last = NULL;
+    if(arena->chunk == NULL)
+        return;
+
+    if(arena->chunk->next == NULL  &&
+       (arena->chunk->size <= arena->chunk_size  ||  arena->chunk->size <= MD_ARENA_KEEP_SIZE))
+    {
+        arena->chunk->used = 0;
+        return;
+    }
+
+    md_arena_free_chunks(arena);
+    /* If this fails, the next md_arena_alloc() simply tries again. */
+    md_arena_add_chunk(arena, (total_size < MD_ARENA_KEEP_SIZE) ? total_size : MD_ARENA_KEEP_SIZE);
+}
+
+const MD_ALLOCATOR*
+md_arena_allocator(MD_ARENA* arena)
+{
+    return &arena->allocator;
+}
@@ -47,6 +47,8 @@
 typedef unsigned MD_SIZE;
 typedef unsigned MD_OFFSET;
 
+#include <stddef.h>
+
 
 /* Block represents a part of document hierarchy structure like a paragraph
  * or list item.
@@ -312,6 +314,19 @@ typedef struct MD_SPAN_WIKILINK {
 #define MD_DIALECT_COMMONMARK               0
 #define MD_DIALECT_GITHUB                   (MD_FLAG_PERMISSIVEAUTOLINKS | MD_FLAG_TABLES | MD_FLAG_STRIKETHROUGH | MD_FLAG_TASKLISTS)
 
+/* Memory allocator.
+ *
+ * The callbacks have the semantics of malloc(), realloc() and free(), except
+ * that they get 'userdata' of the allocator as their last argument. They are
+ * only ever called from within md_parse().
+ */
+typedef struct MD_ALLOCATOR {
+    void* (*alloc)(size_t /*size*/, void* /*userdata*/);
+    void* (*resize)(void* /*ptr*/, size_t /*size*/, void* /*userdata*/);
+    void (*release)(void* /*ptr*/, void* /*userdata*/);
+    void* userdata;
+} MD_ALLOCATOR;
+
 /* Renderer structure.
  */
 typedef struct MD_PARSER {
@@ -357,6 +372,22 @@ typedef struct MD_PARSER {
     /* Reserved. Set to NULL.
      */
     void (*syntax)(void);
+
+    /* Allocator for all the memory md_parse() needs. Optional (may be NULL),
+     * in which case malloc(), realloc() and free() are used.
+     */
+    const MD_ALLOCATOR* allocator;
+
+    /* Work budget. Optional (zero means no limit).
+     *
+     * Each line of the document costs as many units as it is long, and each
+     * block and each inline mark (a potential emphasis delimiter, bracket,
+     * entity etc.) costs one more. Once the budget is used up, md_parse()
+     * gives up and returns MD_BUDGET_EXCEEDED. The costs are checked as the
+     * lines, blocks and inline marks are processed, so a document which is
+     * too expensive to parse is abandoned early.
+     */
+    MD_SIZE budget;
 } MD_PARSER;
 
 
@@ -364,18 +395,71 @@ typedef struct MD_PARSER {
 typedef MD_PARSER MD_RENDERER;
 
 
+/* Return value of md_parse() giving up on MD_PARSER::budget. */
+#define MD_BUDGET_EXCEEDED      (-2)
+
+
 /* Parse the Markdown document stored in the string 'text' of size 'size'.
  * The renderer provides callbacks to be called during the parsing so the
  * caller can render the document on the screen or convert the Markdown
  * to another format.
  *
  * Zero is returned on success. If a runtime error occurs (e.g. a memory
- * fails), -1 is returned. If the processing is aborted due any callback
- * returning non-zero, md_parse() the return value of the callback is returned.
+ * fails), -1 is returned. If MD_PARSER::budget is used up, MD_BUDGET_EXCEEDED
+ * is returned. If the processing is aborted due any callback returning
+ * non-zero, md_parse() the return value of the callback is returned.
  */
 int md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata);
 
 
+/* Parser context for parsing many documents one after another.
+ *
+ * md_parse() grows its working memory anew for each document and frees it
+ * at the end. md_parse_ctx() instead keeps it in the context for the next
+ * document, so once the context has seen documents as big as the usual ones,
+ * parsing needs (nearly) no more allocations. A context may be used by only
+ * one thread at a time.
+ *
+ * After each document, any single buffer bigger than 'keep_size' bytes is
+ * released, so that one huge document does not pin its memory for good.
+ * Zero 'keep_size' means the default of 1 MB.
+ */
+typedef struct MD_PARSER_CTX_tag MD_PARSER_CTX;
+
+MD_PARSER_CTX* md_parser_ctx_new(MD_SIZE keep_size);
+void md_parser_ctx_free(MD_PARSER_CTX* pctx);
+
+/* Release all the working memory kept by the context. */
+void md_parser_ctx_trim(MD_PARSER_CTX* pctx);
+
+/* Same as md_parse(), using the given context (which may be NULL). */
+int md_parse_ctx(MD_PARSER_CTX* pctx, const MD_CHAR* text, MD_SIZE size,
+                 const MD_PARSER* parser, void* userdata);
+
+
+/* Bump arena for use as MD_PARSER::allocator.
+ *
+ * Allocations are carved one after another out of big chunks, freeing is
+ * (nearly) a no-op, and md_arena_reset() releases everything at once, so it
+ * is meant to be reset after each md_parse(). When a document needed more
+ * than one chunk, the reset merges them into one as big as all of them (up
+ * to 1 MB), so an arena reset after each document soon stops allocating.
+ *
+ * With a MD_PARSER_CTX, the working memory the context keeps between the
+ * documents does not come from the arena but from malloc(); only what lives
+ * no longer than the document does.
+ *
+ * Zero 'chunk_size' means the default of 64 KB. An arena may be used by only
+ * one thread at a time.
+ */
+typedef struct MD_ARENA_tag MD_ARENA;
+
+MD_ARENA* md_arena_new(size_t chunk_size);
+void md_arena_free(MD_ARENA* arena);
+void md_arena_reset(MD_ARENA* arena);
+const MD_ALLOCATOR* md_arena_allocator(MD_ARENA* arena);
+
+
 #ifdef __cplusplus
     }  /* extern "C" { */
 #endif
@@ -0,0 +1,237 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Checks that md_parse() takes time linear in the size of pathological
+ * documents, the kinds known to send Markdown parsers quadratic: nested and
+ * unclosed brackets, runs of emphasis delimiters, deep container nesting,
+ * reference and link soup, long labels and permissive autolink soup.
+ *
+ * Each document is generated at n and at 4n repetitions of its pattern and
+ * parsed until the time per parse is known well enough. Linear parsing takes
+ * about 4 times as long for the bigger one, quadratic about 16 times; any
+ * ratio above PATHO_MAX_RATIO fails the check.
+ *
+ * Usage: md4c-patho [n]
+ * Exits with 1 if any document parses super-linearly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "md4c.h"
+
+
+#define SIZEOF_ARRAY(a)     (sizeof(a) / sizeof(a[0]))
+
+#define PATHO_DEFAULT_N     10000
+#define PATHO_MAX_RATIO     8.0
+#define PATHO_MIN_CLOCKS    (CLOCKS_PER_SEC / 20)
+#define PATHO_TRIES         3
+
+#define PATHO_FLAGS         (MD_DIALECT_GITHUB | MD_FLAG_LATEXMATHSPANS | MD_FLAG_WIKILINKS)
+
+/* A document is 'head', 'rep1' n times, 'mid', 'rep2' n times and 'tail'. */
+typedef struct PATHO_CASE {
+    const char* name;
+    const char* head;
+    const char* rep1;
+    const char* mid;
+    const char* rep2;
+    const char* tail;
+} PATHO_CASE;
+
+static const PATHO_CASE cases[] = {
+    { "nested brackets",            "", "[", "a", "]", "" },
+    { "unclosed brackets",          "", "[", "a", "", "" },
+    { "brackets across lines",      "", "[a\n", "", "", "" },
+    { "nested link parentheses",    "", "[](", "", ")", "" },
+    { "unclosed link destinations", "", "[a](", "", "", "" },
+    { "link destinations across lines", "", "[a](\n", "", "", "" },
+    { "unclosed link titles",       "", "![a](b \"", "", "", "" },
+    { "nested link openers",        "", "[a", "", "](/u)", "" },
+    { "emphasis mix",               "", "*a **a ", "", "", "" },
+    { "emphasis delimiter runs",    "", "**", "a", "*", "" },
+    { "underscore openers",         "", "_a ", "", "a_ ", "" },
+    { "intraword delimiters",       "", "a*", "", "*b", "" },
+    { "nested mixed delimiters",    "", "*_", "a", "_*", "" },
+    { "emphasis across lines",      "", "*a\n", "", "", "" },
+    { "strikethrough openers",      "", "~~a ", "", "", "" },
+    { "latex math openers",         "", "$", "a", "", "" },
+    { "backtick runs",              "", "`a``", "", "", "" },
+    { "code span openers across lines", "", "`a\n", "", "", "" },
+    { "raw html openers",           "", "<a ", "", "", "" },
+    { "html comment openers",       "", "<!--", "", "", "" },
+    { "ampersands",                 "", "&", "", "", "" },
+    { "nested block quotes",        "", "> ", "a\n", "", "" },
+    { "nested lists",               "", "- ", "a\n", "", "" },
+    { "nested ordered lists",       "", "1. ", "a\n", "", "" },
+    { "nested quotes and lists",    "", "> - ", "a\n", "", "" },
+    { "lazy quote continuations",   "", "a\n> ", "", "", "" },
+    { "reference soup",             "[x]: /u\n\n", "[x]\n", "", "", "" },
+    { "undefined references",       "[x]: /u\n\n", "[y]\n", "", "", "" },
+    { "duplicate definitions",      "", "[a]: b\n", "\n", "[a] ", "" },
+    { "long labels",                "[x]: /u\n\n",
+      "[aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa]\n",
+      "", "", "" },
+    { "references in table rows",   "| a |\n| - |\n", "| [x] |\n", "\n[x]: /u\n", "", "" },
+    { "wiki link openers",          "", "[[a\n", "", "", "" },
+    { "wiki links",                 "", "[[a]]", "", "", "" },
+    { "www autolink soup",          "", "www.a.b ", "", "", "" },
+    { "www autolinks on lines",     "", "a www.b.c\n", "", "", "" },
+    { "url autolink soup",          "", "http://a.b ", "", "", "" },
+    { "url autolinks on lines",     "", "http://a.b/c\n", "", "", "" },
+    { "email autolink soup",        "", "a@b.c ", "", "", "" },
+    { "www prefixes",               "", "www.", "", "", "" },
+    { "url schemes",                "", "https://", "", "", "" }
+};
+
+
+static char*
+patho_generate(const PATHO_CASE* c, int n, size_t* p_size)
+{
+    size_t len1 = strlen(c->rep1);
+    size_t len2 = strlen(c->rep2);
+    size_t size = strlen(c->head) + n * len1 + strlen(c->mid) + n * len2 + strlen(c->tail);
+    char* doc = (char*) malloc(size + 1);
+    char* p = doc;
+    int i;
+
+    if(doc == NULL)
+        return NULL;
+    p += sprintf(p, "%s", c->head);
+    for(i = 0; i < n; i++, p += len1)
+        memcpy(p, c->rep1, len1);
+    p += sprintf(p, "%s", c->mid);
+    for(i = 0; i < n; i++, p += len2)
+        memcpy(p, c->rep2, len2);
+    sprintf(p, "%s", c->tail);
+    *p_size = size;
+    return doc;
+}
+
+static int
+patho_block(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+patho_span(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return 0;
+}
+
+static int
+patho_text(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    return 0;
+}
+
+/* Returns the seconds a parse of the document takes, the best of a few
+ * measurements, each of as many parses as fit in PATHO_MIN_CLOCKS. */
+static double
+patho_time(const char* doc, size_t size)
+{
+    MD_PARSER parser = {
+        0,
+        PATHO_FLAGS,
+        patho_block,
+        patho_block,
+        patho_span,
+        patho_span,
+        patho_text,
+        NULL,
+        NULL,
+        NULL,
+        0
+    };
+    double best = 0.0;
+    int i;
+
+    for(i = 0; i < PATHO_TRIES; i++) {
+        clock_t beg = clock();
+        clock_t end;
+        int n_parses = 0;
+        double t;
+
+        do {
+            md_parse(doc, (MD_SIZE) size, &parser, NULL);
+            n_parses++;
+            end = clock();
+        } while(end - beg < PATHO_MIN_CLOCKS);
+
+        t = (double) (end - beg) / CLOCKS_PER_SEC / n_parses;
+        if(i == 0  ||  t < best)
+            best = t;
+    }
+
+    return best;
+}
+
+int
+main(int argc, char** argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : PATHO_DEFAULT_N;
+    int n_failed = 0;
+    size_t i;
+
+    if(n <= 0) {
+        fprintf(stderr, "Usage: %s [n]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 0; i < SIZEOF_ARRAY(cases); i++) {
+        char* small;
+        char* big;
+        size_t small_size;
+        size_t big_size;
+        double ratio;
+
+        small = patho_generate(&cases[i], n, &small_size);
+        big = patho_generate(&cases[i], 4 * n, &big_size);
+        if(small == NULL  ||  big == NULL) {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            return 2;
+        }
+
+        ratio = patho_time(big, big_size) / patho_time(small, small_size);
+        printf("%-32s %5.1f%s\n", cases[i].name, ratio,
+               (ratio > PATHO_MAX_RATIO) ? "  SUPER-LINEAR" : "");
+        fflush(stdout);
+        if(ratio > PATHO_MAX_RATIO)
+            n_failed++;
+
+        free(small);
+        free(big);
+    }
+
+    if(n_failed > 0) {
+        printf("%d of %d documents parse super-linearly.\n", n_failed, (int) SIZEOF_ARRAY(cases));
+        return 1;
+    }
+    return 0;
+}
@@ -29,6 +29,17 @@
 #include "render_html.h"
 #include "entity.h"
 
+/* Text is searched for characters needing escaping 16 bytes at a time where
+ * SSE2 is always there; define MD4C_NO_SIMD to keep the plain loop. */
+#if !defined MD4C_NO_SIMD  &&  (defined __SSE2__  ||  defined _M_X64  ||  \
+                                (defined _M_IX86_FP  &&  _M_IX86_FP >= 2))
+    #define RENDER_SIMD_SSE2    1
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
 
 #ifdef _MSC_VER
     /* MSVC does not understand "inline" when building as pure C (not C++).
@@ -43,6 +54,9 @@
 #endif
 
 
+/* Output is collected here and handed to process_output() in large pieces
+ * rather than a call per text fragment, tag and escaped character. */
+#define RENDER_OUTPUT_SIZE      4096
 
 typedef struct MD_RENDER_HTML_tag MD_RENDER_HTML;
 struct MD_RENDER_HTML_tag {
@@ -51,6 +65,8 @@ struct MD_RENDER_HTML_tag {
     unsigned flags;
     int image_nesting_level;
     char escape_map[256];
+    MD_SIZE output_size;
+    MD_CHAR output[RENDER_OUTPUT_SIZE];
 };
 
 
@@ -64,31 +80,93 @@ struct MD_RENDER_HTML_tag {
 #define ISALNUM(ch)     (ISLOWER(ch) || ISUPPER(ch) || ISDIGIT(ch))
 
 
+static void
+render_flush(MD_RENDER_HTML* r)
+{
+    if(r->output_size > 0) {
+        r->process_output(r->output, r->output_size, r->userdata);
+        r->output_size = 0;
+    }
+}
+
 static inline void
 render_text(MD_RENDER_HTML* r, const MD_CHAR* text, MD_SIZE size)
 {
-    r->process_output(text, size, r->userdata);
+    if(size > RENDER_OUTPUT_SIZE - r->output_size) {
+        render_flush(r);
+        /* Not worth copying what would fill the buffer on its own. */
+        if(size > RENDER_OUTPUT_SIZE / 2) {
+            r->process_output(text, size, r->userdata);
+            return;
+        }
+    }
+    memcpy(r->output + r->output_size, text, size);
+    r->output_size += size;
 }
 
 #define RENDER_LITERAL(r, literal)    render_text((r), (literal), (MD_SIZE) strlen(literal))
 
 
+#ifdef RENDER_SIMD_SSE2
+#ifdef _MSC_VER
+static inline unsigned
+render_first_bit(unsigned mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+}
+#else
+    #define render_first_bit(mask)      ((unsigned) __builtin_ctz(mask))
+#endif
+#endif
+
+/* Returns offset of the first character in data[off..size) which needs to be
+ * escaped in HTML text, or size if there is none. */
+static MD_OFFSET
+render_html_skip_plain(MD_RENDER_HTML* r, const MD_CHAR* data, MD_OFFSET off, MD_SIZE size)
+{
+    /* Some characters need to be escaped in normal HTML text. */
+    #define HTML_NEED_ESCAPE(ch)        (r->escape_map[(unsigned char)(ch)] != 0)
+
+#ifdef RENDER_SIMD_SSE2
+    /* The same four characters md_render_html() puts in escape_map[]. */
+    if(off + 16 <= size) {
+        const __m128i quot = _mm_set1_epi8('"');
+        const __m128i amp = _mm_set1_epi8('&');
+        const __m128i lt = _mm_set1_epi8('<');
+        const __m128i gt = _mm_set1_epi8('>');
+
+        do {
+            __m128i v = _mm_loadu_si128((const __m128i*) (data + off));
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, amp)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)));
+            unsigned mask = (unsigned) _mm_movemask_epi8(hit);
+
+            if(mask != 0)
+                return off + render_first_bit(mask);
+            off += 16;
+        } while(off + 16 <= size);
+    }
+#endif
+
+    /* Optimization: Use some loop unrolling. */
+    while(off + 3 < size  &&  !HTML_NEED_ESCAPE(data[off+0])  &&  !HTML_NEED_ESCAPE(data[off+1])
+                          &&  !HTML_NEED_ESCAPE(data[off+2])  &&  !HTML_NEED_ESCAPE(data[off+3]))
+        off += 4;
+    while(off < size  &&  !HTML_NEED_ESCAPE(data[off]))
+        off++;
+    return off;
+}
+
 static void
 render_html_escaped(MD_RENDER_HTML* r, const MD_CHAR* data, MD_SIZE size)
 {
     MD_OFFSET beg = 0;
     MD_OFFSET off = 0;
 
-    /* Some characters need to be escaped in normal HTML text. */
-    #define HTML_NEED_ESCAPE(ch)        (r->escape_map[(unsigned char)(ch)] != 0)
-
     while(1) {
-        /* Optimization: Use some loop unrolling. */
-        while(off + 3 < size  &&  !HTML_NEED_ESCAPE(data[off+0])  &&  !HTML_NEED_ESCAPE(data[off+1])
-                              &&  !HTML_NEED_ESCAPE(data[off+2])  &&  !HTML_NEED_ESCAPE(data[off+3]))
-            off += 4;
-        while(off < size  &&  !HTML_NEED_ESCAPE(data[off]))
-            off++;
+        off = render_html_skip_plain(r, data, off, size);
 
         if(off > beg)
             render_text(r, data + beg, off - beg);
@@ -115,10 +193,34 @@ render_url_escaped(MD_RENDER_HTML* r, const MD_CHAR* data, MD_SIZE size)
     MD_OFFSET beg = 0;
     MD_OFFSET off = 0;
 
-    #define URL_NEED_ESCAPE(ch)                                             \
-            (!ISALNUM(ch)  &&  strchr("-_.+!*'(),%#@?=;:/,+$", ch) == NULL)
+    /* Everything but alphanumerics and "-_.+!*'(),%#@?=;:/$" (and NUL, which
+     * the strchr() this table replaces used to find as the terminator). */
+    static const unsigned char url_escape_map[256] = {
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,     /* 0x00 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,     /* 0x10 */
+        1, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,     /* 0x20:  !"#$%&'()*+,-./ */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0,     /* 0x30: 0123456789:;<=>? */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     /* 0x40: @ABCDEFGHIJKLMNO */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0,     /* 0x50: PQRSTUVWXYZ[\]^_ */
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     /* 0x60: `abcdefghijklmno */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,     /* 0x70: pqrstuvwxyz{|}~ */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,     /* 0x80 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+    };
+
+    #define URL_NEED_ESCAPE(ch)         (url_escape_map[(unsigned char)(ch)] != 0)
 
     while(1) {
+        /* Optimization: Use some loop unrolling. */
+        while(off + 3 < size  &&  !URL_NEED_ESCAPE(data[off+0])  &&  !URL_NEED_ESCAPE(data[off+1])
+                              &&  !URL_NEED_ESCAPE(data[off+2])  &&  !URL_NEED_ESCAPE(data[off+3]))
+            off += 4;
         while(off < size  &&  !URL_NEED_ESCAPE(data[off]))
             off++;
         if(off > beg)
@@ -503,11 +605,13 @@ debug_log_callback(const char* msg, void* userdata)
 }
 
 int
-md_render_html(const MD_CHAR* input, MD_SIZE input_size,
-               void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
-               void* userdata, unsigned parser_flags, unsigned renderer_flags)
+md_render_html_ctx(MD_PARSER_CTX* pctx, const MD_ALLOCATOR* allocator, MD_SIZE budget,
+                   const MD_CHAR* input, MD_SIZE input_size,
+                   void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                   void* userdata, unsigned parser_flags, unsigned renderer_flags)
 {
-    MD_RENDER_HTML render = { process_output, userdata, renderer_flags, 0, { 0 } };
+    MD_RENDER_HTML render;
+    int ret;
 
     MD_PARSER parser = {
         0,
@@ -518,14 +622,33 @@ md_render_html(const MD_CHAR* input, MD_SIZE input_size,
         leave_span_callback,
         text_callback,
         debug_log_callback,
-        NULL
+        NULL,
+        allocator,
+        budget
     };
 
+    render.process_output = process_output;
+    render.userdata = userdata;
+    render.flags = renderer_flags;
+    render.image_nesting_level = 0;
+    memset(render.escape_map, 0, sizeof(render.escape_map));
     render.escape_map[(unsigned char)'"'] = 1;
     render.escape_map[(unsigned char)'&'] = 1;
     render.escape_map[(unsigned char)'<'] = 1;
     render.escape_map[(unsigned char)'>'] = 1;
+    render.output_size = 0;
+
+    ret = md_parse_ctx(pctx, input, input_size, &parser, (void*) &render);
+    render_flush(&render);
+    return ret;
+}
 
-    return md_parse(input, input_size, &parser, (void*) &render);
+int
+md_render_html(const MD_CHAR* input, MD_SIZE input_size,
+               void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+               void* userdata, unsigned parser_flags, unsigned renderer_flags)
+{
+    return md_render_html_ctx(NULL, NULL, 0, input, input_size, process_output,
+                              userdata, parser_flags, renderer_flags);
 }
 
@@ -58,6 +58,18 @@ int md_render_html(const MD_CHAR* input, MD_SIZE input_size,
                    void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
                    void* userdata, unsigned parser_flags, unsigned renderer_flags);
 
+/* Same as md_render_html(), parsing with the given context (see md_parse_ctx())
+ * and allocator (see MD_PARSER::allocator), either of which may be NULL, and
+ * with the given work budget (see MD_PARSER::budget; zero for none).
+ *
+ * Returns MD_BUDGET_EXCEEDED if the budget is used up. The output produced
+ * until then is incomplete and should be discarded.
+ */
+int md_render_html_ctx(MD_PARSER_CTX* pctx, const MD_ALLOCATOR* allocator, MD_SIZE budget,
+                       const MD_CHAR* input, MD_SIZE input_size,
+                       void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                       void* userdata, unsigned parser_flags, unsigned renderer_flags);
+
 
 #ifdef __cplusplus
     }  /* extern "C" { */
@@ -0,0 +1,256 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Builds unicode_table.h, the Unicode lookup tables of md4c.c, from the
+ * codepoint maps in unicode_map.h.
+ *
+ * The tables have two stages: the codepoints are cut into blocks of 16,
+ * identical blocks are stored only once, and an index maps each block of
+ * codepoints to its stored block. An entry carries the
+ * whitespace and punctuation bits of the codepoint and the index of its
+ * record in the case folding table. Single codepoint folds are recorded as
+ * the offset to add, so that whole ranges of letters share a record and
+ * most blocks come out the same. Looking a codepoint up then takes two loads.
+ *
+ * Usage: unicode_gen <output file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unicode_map.h"
+
+
+#define SIZEOF_ARRAY(a)     (sizeof(a) / sizeof(a[0]))
+
+#define BLOCK_SHIFT         4
+#define BLOCK_SIZE          (1 << BLOCK_SHIFT)
+#define MAX_CODEPOINT       0x10ffff
+
+#define ENTRY_WHITESPACE    0x1
+#define ENTRY_PUNCT         0x2
+#define ENTRY_FOLD_SHIFT    2
+#define MAX_FOLDS           (0xffff >> ENTRY_FOLD_SHIFT)
+
+typedef struct FOLD {
+    unsigned n_codepoints;
+    unsigned codepoints[3];
+} FOLD;
+
+static unsigned short* entries;
+static FOLD folds[MAX_FOLDS];
+static unsigned n_folds;
+
+/* Same as md_unicode_bsearch__() of md4c.c, which these tables replace. */
+static int
+map_search(unsigned codepoint, const unsigned* map, size_t map_size)
+{
+    int beg, end;
+    int pivot_beg, pivot_end;
+
+    beg = 0;
+    end = (int) map_size-1;
+    while(beg <= end) {
+        pivot_beg = pivot_end = (beg + end) / 2;
+        if(map[pivot_end] & 0x40000000)
+            pivot_end++;
+        if(map[pivot_beg] & 0x80000000)
+            pivot_beg--;
+
+        if(codepoint < (map[pivot_beg] & 0x00ffffff))
+            end = pivot_beg - 1;
+        else if(codepoint > (map[pivot_end] & 0x00ffffff))
+            beg = pivot_end + 1;
+        else
+            return pivot_beg;
+    }
+
+    return -1;
+}
+
+/* The folding of a codepoint, as md_get_unicode_fold_info() used to find it. */
+static void
+get_fold(unsigned codepoint, FOLD* fold)
+{
+    static const struct {
+        const unsigned* map;
+        const unsigned* data;
+        size_t map_size;
+        unsigned n_codepoints;
+    } FOLD_MAP_LIST[] = {
+        { FOLD_MAP_1, FOLD_MAP_1_DATA, SIZEOF_ARRAY(FOLD_MAP_1), 1 },
+        { FOLD_MAP_2, FOLD_MAP_2_DATA, SIZEOF_ARRAY(FOLD_MAP_2), 2 },
+        { FOLD_MAP_3, FOLD_MAP_3_DATA, SIZEOF_ARRAY(FOLD_MAP_3), 3 }
+    };
+    size_t i;
+
+    memset(fold, 0, sizeof(FOLD));
+    for(i = 0; i < SIZEOF_ARRAY(FOLD_MAP_LIST); i++) {
+        const unsigned* map = FOLD_MAP_LIST[i].map;
+        unsigned n_codepoints = FOLD_MAP_LIST[i].n_codepoints;
+        const unsigned* codepoints;
+        int index;
+
+        index = map_search(codepoint, map, FOLD_MAP_LIST[i].map_size);
+        if(index < 0)
+            continue;
+
+        codepoints = FOLD_MAP_LIST[i].data + (index * n_codepoints);
+        memcpy(fold->codepoints, codepoints, sizeof(unsigned) * n_codepoints);
+        fold->n_codepoints = n_codepoints;
+        if(map[index] != codepoint) {
+            if((map[index] & 0x00ffffff)+1 == codepoints[0])
+                fold->codepoints[0] = codepoint + ((codepoint & 0x1) == (map[index] & 0x1) ? 1 : 0);
+            else
+                fold->codepoints[0] += (codepoint - (map[index] & 0x00ffffff));
+        }
+        return;
+    }
+
+    fold->n_codepoints = 1;
+    fold->codepoints[0] = codepoint;
+}
+
+static unsigned
+fold_index(const FOLD* fold)
+{
+    unsigned i;
+
+    for(i = 0; i < n_folds; i++) {
+        if(memcmp(&folds[i], fold, sizeof(FOLD)) == 0)
+            return i;
+    }
+    if(n_folds >= MAX_FOLDS) {
+        fprintf(stderr, "unicode_gen: too many distinct case foldings\n");
+        exit(1);
+    }
+    folds[n_folds] = *fold;
+    return n_folds++;
+}
+
+int
+main(int argc, char** argv)
+{
+    unsigned limit = 0;
+    unsigned n_blocks, n_stored = 0;
+    unsigned* block_index;
+    unsigned cp, b, i;
+    FOLD identity = { 1, { 0, 0, 0 } };
+    FILE* f;
+
+    if(argc != 2) {
+        fprintf(stderr, "Usage: unicode_gen <output file>\n");
+        return 1;
+    }
+
+    entries = (unsigned short*) calloc(MAX_CODEPOINT + 1, sizeof(unsigned short));
+    if(entries == NULL) {
+        fprintf(stderr, "unicode_gen: out of memory\n");
+        return 1;
+    }
+
+    /* Record 0 is the identity, so that all the blocks without anything
+     * interesting are the same. */
+    fold_index(&identity);
+
+    for(cp = 0; cp <= MAX_CODEPOINT; cp++) {
+        FOLD fold;
+        unsigned entry = 0;
+
+        if(map_search(cp, WHITESPACE_MAP, SIZEOF_ARRAY(WHITESPACE_MAP)) >= 0)
+            entry |= ENTRY_WHITESPACE;
+        if(map_search(cp, PUNCT_MAP, SIZEOF_ARRAY(PUNCT_MAP)) >= 0)
+            entry |= ENTRY_PUNCT;
+
+        get_fold(cp, &fold);
+        if(fold.n_codepoints == 1)
+            fold.codepoints[0] -= cp;
+        entry |= fold_index(&fold) << ENTRY_FOLD_SHIFT;
+
+        entries[cp] = (unsigned short) entry;
+        if(entry != 0)
+            limit = cp + 1;
+    }
+
+    /* Past the last interesting codepoint, the tables end. */
+    n_blocks = (limit + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    block_index = (unsigned*) malloc(n_blocks * sizeof(unsigned));
+    if(block_index == NULL) {
+        fprintf(stderr, "unicode_gen: out of memory\n");
+        return 1;
+    }
+    for(b = 0; b < n_blocks; b++) {
+        for(i = 0; i < n_stored; i++) {
+            if(memcmp(&entries[i * BLOCK_SIZE], &entries[b * BLOCK_SIZE], BLOCK_SIZE * sizeof(unsigned short)) == 0)
+                break;
+        }
+        if(i == n_stored) {
+            /* A new one; the stored blocks are compacted at the start of entries[]. */
+            memmove(&entries[i * BLOCK_SIZE], &entries[b * BLOCK_SIZE], BLOCK_SIZE * sizeof(unsigned short));
+            n_stored++;
+        }
+        block_index[b] = i;
+    }
+    if(n_stored > 0xff) {
+        fprintf(stderr, "unicode_gen: too many distinct blocks\n");
+        return 1;
+    }
+
+    f = fopen(argv[1], "w");
+    if(f == NULL) {
+        fprintf(stderr, "unicode_gen: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(f, "/* Generated by unicode_gen from unicode_map.h. Do not edit. */\n\n");
+    fprintf(f, "#define MD_UNICODE_LIMIT            0x%x\n", n_blocks * BLOCK_SIZE);
+    fprintf(f, "#define MD_UNICODE_BLOCK_SHIFT      %d\n", BLOCK_SHIFT);
+    fprintf(f, "#define MD_UNICODE_WHITESPACE       0x%x\n", ENTRY_WHITESPACE);
+    fprintf(f, "#define MD_UNICODE_PUNCT            0x%x\n", ENTRY_PUNCT);
+    fprintf(f, "#define MD_UNICODE_FOLD_SHIFT       %d\n\n", ENTRY_FOLD_SHIFT);
+
+    fprintf(f, "static const unsigned char MD_UNICODE_BLOCKS[%u] = {", n_blocks);
+    for(b = 0; b < n_blocks; b++)
+        fprintf(f, "%s%u,", (b % 16 == 0) ? "\n    " : " ", block_index[b]);
+    fprintf(f, "\n};\n\n");
+
+    fprintf(f, "static const unsigned short MD_UNICODE_ENTRIES[%u] = {", n_stored * BLOCK_SIZE);
+    for(i = 0; i < n_stored * BLOCK_SIZE; i++)
+        fprintf(f, "%s0x%04x,", (i % 12 == 0) ? "\n    " : " ", entries[i]);
+    fprintf(f, "\n};\n\n");
+
+    fprintf(f, "static const MD_UNICODE_FOLD MD_UNICODE_FOLDS[%u] = {\n", n_folds);
+    for(i = 0; i < n_folds; i++) {
+        fprintf(f, "    { %u, { 0x%x, 0x%x, 0x%x } },\n", folds[i].n_codepoints,
+                folds[i].codepoints[0], folds[i].codepoints[1], folds[i].codepoints[2]);
+    }
+    fprintf(f, "};\n");
+
+    fclose(f);
+    free(block_index);
+    free(entries);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+
+#include "tinydir.h"
+
+#include "archive.h"
+#include "buffer.h"
+#include "file.h"
+#include "html.h"
+#include "http.h"
+
+#include "debugalloc.h"
+
+// compiles ./blog/ and ./data/ into a single archive the server can run from with -a
+
+typedef struct item {
+	char* path;
+	buffer head;
+	buffer body;
+} item;
+
+static item* items = NULL;
+static size_t item_count = 0, item_cap = 0;
+
+static item* add_item(const char* path) {
+	item* it;
+	if (item_count == item_cap) {
+		size_t cap = item_cap ? item_cap * 2 : 32;
+		item* p = realloc(items, cap * sizeof(*items));
+		if (!p)
+			return NULL;
+		items = p;
+		item_cap = cap;
+	}
+	it = &items[item_count];
+	memset(it, 0, sizeof(*it));
+	it->path = malloc(strlen(path) + 1);
+	if (!it->path)
+		return NULL;
+	strcpy(it->path, path);
+	item_count++;
+	return it;
+}
+
+// builds the response head for a body that is already in place
+static int finish_item(item* it, int code, const char* msg, const char* content_type) {
+	return http_head(&it->head, code, msg, content_type, it->body.len, hash_data(it->body.data, it->body.len));
+}
+
+static int pack_page(const char* path, int (*render)(buffer*, const char*, time_t*)) {
+	time_t mtime;
+	item* it = add_item(path);
+	if (!it)
+		return 0;
+	if (!render(&it->body, path, &mtime)) {
+		fprintf(stderr, "website-pack: failed to render %s\n", path);
+		return 0;
+	}
+	return finish_item(it, 200, "Hello there", "text/html");
+}
+
+static int pack_static(const char* path, const char* file) {
+	char* data = read_file(file);
+	item* it = add_item(path);
+	int ok = data && it && buffer_append_str(&it->body, data)
+		&& finish_item(it, 200, "Hello there", "text/css");
+	free(data);
+	return ok;
+}
+
+static int pack_not_found() {
+	item* it = add_item(ARCHIVE_NOT_FOUND);
+	return it && render_not_found(&it->body)
+		&& finish_item(it, 404, "Not Found", "text/html");
+}
+
+static int pack_dir(const char* dir_path, const char* extension, int (*pack)(const char* name, const char* file)) {
+	tinydir_dir dir;
+	int ok = 1;
+	if (tinydir_open(&dir, dir_path) == -1)
+		return 1;
+	while (ok && dir.has_next) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+		if (!file.is_dir && valid_file(file.name, extension)) {
+			char path[_TINYDIR_FILENAME_MAX + 2];
+			sprintf(path, "/%s", file.name);
+			ok = pack(path, file.path);
+		}
+		tinydir_next(&dir);
+	}
+	tinydir_close(&dir);
+	return ok;
+}
+
+static int pack_post(const char* path, const char* file) {
+	return pack_page(path, render_page);
+}
+
+static int compare_items(const void* a, const void* b) {
+	return strcmp(((const item*)a)->path, ((const item*)b)->path);
+}
+
+static int write_archive(const char* path) {
+	archive_header header;
+	uint64_t off;
+	char* tmp = malloc(strlen(path) + 5);
+	FILE* fp;
+	int ok;
+	if (!tmp)
+		return 0;
+	sprintf(tmp, "%s.tmp", path);
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		free(tmp);
+		return 0;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ARCHIVE_MAGIC, 8);
+	header.count = (uint32_t)item_count;
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	off = sizeof(header) + item_count * sizeof(archive_entry);
+	for (size_t i = 0; ok && i < item_count; i++) {
+		archive_entry e;
+		memset(&e, 0, sizeof(e));
+		e.path_off = (uint32_t)off;
+		e.path_len = (uint32_t)strlen(items[i].path);
+		e.head_off = e.path_off + e.path_len;
+		e.head_len = items[i].head.len;
+		e.body_off = e.head_off + e.head_len;
+		e.body_len = items[i].body.len;
+		e.etag = hash_data(items[i].body.data, items[i].body.len);
+		off = e.body_off + e.body_len;
+		ok = fwrite(&e, sizeof(e), 1, fp) == 1;
+	}
+	for (size_t i = 0; ok && i < item_count; i++) {
+		ok = fwrite(items[i].path, 1, strlen(items[i].path), fp) == strlen(items[i].path)
+			&& fwrite(items[i].head.data, 1, items[i].head.len, fp) == items[i].head.len
+			&& fwrite(items[i].body.data, 1, items[i].body.len, fp) == items[i].body.len;
+	}
+	if (fclose(fp))
+		ok = 0;
+	// swapping the archive in with a rename is what makes deploys atomic
+	if (ok) {
+#ifdef _WIN32
+		remove(path);
+#endif
+		ok = !rename(tmp, path);
+	}
+	if (!ok)
+		remove(tmp);
+	free(tmp);
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	const char* output = argc > 1 ? argv[1] : "site.pack";
+	int ok;
+	setlocale(LC_ALL, "");
+
+	html_thread_start();
+	ok = pack_page("/", render_index)
+		&& pack_dir("./blog/", ".md", pack_post)
+		&& pack_dir("./data/", ".css", pack_static)
+		&& pack_not_found();
+	if (ok) {
+		qsort(items, item_count, sizeof(*items), compare_items);
+		ok = write_archive(output);
+	}
+	html_thread_stop();
+	for (size_t i = 0; i < item_count; i++) {
+		free(items[i].path);
+		buffer_free(&items[i].head);
+		buffer_free(&items[i].body);
+	}
+	free(items);
+	if (!ok) {
+		fprintf(stderr, "website-pack: failed to write %s\n", output);
+		return EXIT_FAILURE;
+	}
+	printf("website-pack: %u entries written to %s\n", (unsigned)item_count, output);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include "posts.h"
+#include "epoch.h"
+#include "file.h"
+#include "thread.h"
+#include "tinydir.h"
+
+#include "debugalloc.h"
+
+#define BLOG_DIR "./blog/"
+
+// open addressing, linear probing. a rescan builds a new set and swaps it in whole,
+// so lookups from other threads never see one half built.
+typedef struct post_set {
+	char** slots;
+	size_t count;
+} post_set;
+
+static post_set* volatile posts = NULL;
+static time_t dir_mtime = 0;
+static time_t last_check = 0;
+static time_t last_scan = 0;
+
+static void set_free(void* p) {
+	post_set* set = (post_set*)p;
+	if (!set)
+		return;
+	for (size_t i = 0; i < set->count; i++)
+		free(set->slots[i]);
+	free(set->slots);
+	free(set);
+}
+
+static char set_insert(char** set, size_t count, const char* name) {
+	size_t len = strlen(name);
+	size_t i = hash_string(name, len) & (count - 1);
+	while (set[i]) {
+		if (!strcmp(set[i], name))
+			return 1;
+		i = (i + 1) & (count - 1);
+	}
+	set[i] = malloc(len + 1);
+	if (!set[i])
+		return 0;
+	memcpy(set[i], name, len + 1);
+	return 1;
+}
+
+static int posts_rebuild() {
+	tinydir_dir dir;
+	size_t files = 0, count = 16;
+	post_set* old = posts;
+	post_set* set;
+	if (tinydir_open(&dir, BLOG_DIR) == -1)
+		return 0;
+	while (dir.has_next) {
+		files++;
+		tinydir_next(&dir);
+	}
+	while (count < files * 2)
+		count <<= 1;
+	set = malloc(sizeof(*set));
+	if (set)
+		set->slots = calloc(count, sizeof(*set->slots));
+	if (!set || !set->slots) {
+		free(set);
+		tinydir_close(&dir);
+		return 0;
+	}
+	set->count = count;
+	tinydir_close(&dir);
+	tinydir_open(&dir, BLOG_DIR);
+	// the directory may have grown between the two passes
+	for (files = 0; dir.has_next && files < count / 2; tinydir_next(&dir)) {
+		tinydir_file file;
+		tinydir_readfile(&dir, &file);
+		if (file.is_dir)
+			continue;
+		if (!set_insert(set->slots, count, file.name)) {
+			tinydir_close(&dir);
+			set_free(set);
+			return 0;
+		}
+		files++;
+	}
+	tinydir_close(&dir);
+	atomic_store_ptr((void* volatile*)&posts, set);
+	if (old)
+		epoch_retire(set_free, old);
+	return 1;
+}
+
+// rescans the blog directory at most once a second, and only when its mtime moved. mtime
+// only has whole seconds, so a change later in the second of the last rescan would not
+// move it: while the mtime is no older than that rescan, the directory is scanned again.
+int posts_refresh() {
+	time_t now = time(NULL), mtime;
+	if (posts && now == last_check)
+		return 1;
+	last_check = now;
+	mtime = file_mtime(BLOG_DIR);
+	if (posts && mtime == dir_mtime && mtime < last_scan)
+		return 1;
+	if (!posts_rebuild())
+		return 0;
+	dir_mtime = mtime;
+	last_scan = now;
+	return 1;
+}
+
+char posts_contains(const char* name) {
+	const post_set* set;
+	char found = 0;
+	// without a way to look safely, let the render find out whether the post exists
+	if (!epoch_enter())
+		return 1;
+	set = (const post_set*)atomic_load_ptr((void* volatile*)&posts);
+	if (set) {
+		size_t i = hash_string(name, strlen(name)) & (set->count - 1);
+		while (set->slots[i]) {
+			if (!strcmp(set->slots[i], name)) {
+				found = 1;
+				break;
+			}
+			i = (i + 1) & (set->count - 1);
+		}
+	}
+	epoch_exit();
+	return found;
+}
+
+void posts_free() {
+	set_free(posts);
+	posts = NULL;
+}
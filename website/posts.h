@@ -0,0 +1,7 @@
+#pragma once
+
+// set of the post file names in ./blog/, used to reject unknown paths
+// without touching the filesystem
+int posts_refresh();
+char posts_contains(const char* name);
+void posts_free();
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "prefork.h"
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "debugalloc.h"
+
+#ifdef _WIN32
+
+int prefork_run(int workers, const prefork_hooks* hooks, volatile sig_atomic_t* running) {
+	return 0;
+}
+
+#else
+
+static pid_t spawn(const prefork_hooks* hooks, int slot) {
+	pid_t pid;
+	fflush(NULL); // or anything buffered gets written once per worker
+	pid = fork();
+	if (pid == 0) {
+		hooks->serve(slot);
+		_exit(EXIT_SUCCESS);
+	}
+	if (pid == -1)
+		perror("fork");
+	return pid;
+}
+
+int prefork_run(int workers, const prefork_hooks* hooks, volatile sig_atomic_t* running) {
+	pid_t* pids = calloc(workers, sizeof(*pids));
+	if (!pids)
+		return 0;
+	while (*running) {
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (int i = 0; i < workers; i++) {
+				if (pids[i] == pid)
+					pids[i] = 0;
+			}
+			if (WIFSIGNALED(status))
+				fprintf(stderr, "worker %d killed by signal %d, restarting\n", (int)pid, WTERMSIG(status));
+			else if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS)
+				fprintf(stderr, "worker %d exited with %d, restarting\n", (int)pid, WEXITSTATUS(status));
+			if (hooks->exited)
+				hooks->exited((int)pid);
+		}
+		// workers that failed to start are retried on the next tick
+		for (int i = 0; i < workers; i++) {
+			if (pids[i] <= 0)
+				pids[i] = spawn(hooks, i);
+		}
+		if (hooks->tick)
+			hooks->tick();
+		sleep(1);
+	}
+	for (int i = 0; i < workers; i++) {
+		if (pids[i] > 0)
+			kill(pids[i], SIGTERM);
+	}
+	for (int i = 0; i < workers; i++) {
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+	return 1;
+}
+
+#endif
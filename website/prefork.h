@@ -0,0 +1,14 @@
+#pragma once
+#include <signal.h>
+
+typedef struct prefork_hooks {
+	void (*serve)(int slot); // runs in each worker, returns once the worker should exit.
+	                         // a restarted worker takes over the slot of the one it replaces.
+	void (*tick)(void);      // runs in the supervisor about once a second
+	void (*exited)(int pid); // runs in the supervisor after a worker exited
+} prefork_hooks;
+
+// forks `workers` processes that inherit everything set up so far, the listening socket
+// included, and restarts any that exit until `running` is cleared. returns 0 where fork
+// is not available.
+int prefork_run(int workers, const prefork_hooks* hooks, volatile sig_atomic_t* running);
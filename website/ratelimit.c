@@ -0,0 +1,245 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ratelimit.h"
+#include "file.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+#define RATELIMIT_SHARDS 16          // each with its own lock, so loops rarely contend
+#define RATELIMIT_SHARD_CLIENTS 512
+#define RATELIMIT_SHARD_BUCKETS 1024
+#define RATELIMIT_BURST_SECONDS 2    // a bucket holds this many seconds' worth of requests
+#define RATELIMIT_EVICT_SCAN 8       // how far up from the least recently seen to look for an idle client
+#define REJECT_BODY "too many requests\n"
+
+static const char reject_head[] =
+	"HTTP/1.1 429 Too Many Requests\r\n"
+	"Content-Type: text/plain\r\n"
+	"Content-Length: 18\r\n"
+	"Retry-After: 1\r\n"
+	"Cache-Control: no-store\r\n";
+
+typedef struct client {
+	char address[46];
+	uint32_t hash;
+	int next;             // in the bucket's chain, -1 at its end
+	int newer, older;     // in the shard's recency list, -1 at either end
+	int connections;
+	uint32_t tokens;      // thousandths of a request
+	uint64_t refilled;    // milliseconds
+	char used;
+} client;
+
+typedef struct shard {
+	mutex lock;
+	int buckets[RATELIMIT_SHARD_BUCKETS];
+	client clients[RATELIMIT_SHARD_CLIENTS];
+	int newest, oldest;
+} shard;
+
+static shard* shards = NULL;
+static unsigned rate = 0;
+static uint32_t capacity = 0;
+static int max_connections = 0;
+static volatile int rejected = 0;
+static volatile int refused = 0;
+
+static uint64_t now_ms() {
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+void ratelimit_set_rate(unsigned per_second) {
+	// tokens are counted in 32 bits, so a huge rate gets the biggest bucket there is
+	uint64_t tokens = (uint64_t)per_second * RATELIMIT_BURST_SECONDS * 1000;
+	rate = per_second;
+	capacity = tokens > UINT32_MAX ? UINT32_MAX : (uint32_t)tokens;
+}
+
+void ratelimit_set_connections(int max) {
+	max_connections = max;
+}
+
+// every client starts out unused, in the recency list in slot order
+int ratelimit_init() {
+	if (!rate && !max_connections)
+		return 1;
+	shards = calloc(RATELIMIT_SHARDS, sizeof(*shards));
+	if (!shards)
+		return 0;
+	for (int i = 0; i < RATELIMIT_SHARDS; i++) {
+		shard* sh = &shards[i];
+		mutex_init(&sh->lock);
+		memset(sh->buckets, -1, sizeof(sh->buckets));
+		for (int c = 0; c < RATELIMIT_SHARD_CLIENTS; c++) {
+			sh->clients[c].newer = c - 1;
+			sh->clients[c].older = c + 1 < RATELIMIT_SHARD_CLIENTS ? c + 1 : -1;
+		}
+		sh->newest = 0;
+		sh->oldest = RATELIMIT_SHARD_CLIENTS - 1;
+	}
+	return 1;
+}
+
+static void unlink_recent(shard* sh, int i) {
+	client* c = &sh->clients[i];
+	if (c->newer != -1)
+		sh->clients[c->newer].older = c->older;
+	else
+		sh->newest = c->older;
+	if (c->older != -1)
+		sh->clients[c->older].newer = c->newer;
+	else
+		sh->oldest = c->newer;
+}
+
+static void touch(shard* sh, int i) {
+	client* c = &sh->clients[i];
+	if (sh->newest == i)
+		return;
+	unlink_recent(sh, i);
+	c->newer = -1;
+	c->older = sh->newest;
+	sh->clients[sh->newest].newer = i;
+	sh->newest = i;
+}
+
+static void unlink_bucket(shard* sh, int i) {
+	client* c = &sh->clients[i];
+	int* link = &sh->buckets[c->hash & (RATELIMIT_SHARD_BUCKETS - 1)];
+	while (*link != i)
+		link = &sh->clients[*link].next;
+	*link = c->next;
+}
+
+// called locked. a new client takes the least recently seen slot, preferring one with
+// no connections open, whose count would otherwise be lost
+static client* find(shard* sh, const char* address, uint32_t hash, char create) {
+	int* bucket = &sh->buckets[hash & (RATELIMIT_SHARD_BUCKETS - 1)];
+	int i, victim;
+	client* c;
+	for (i = *bucket; i != -1; i = sh->clients[i].next) {
+		c = &sh->clients[i];
+		if (c->hash == hash && !strcmp(c->address, address)) {
+			touch(sh, i);
+			return c;
+		}
+	}
+	if (!create)
+		return NULL;
+	victim = sh->oldest;
+	for (int n = 0, j = sh->oldest; n < RATELIMIT_EVICT_SCAN && j != -1; n++, j = sh->clients[j].newer) {
+		if (!sh->clients[j].used || !sh->clients[j].connections) {
+			victim = j;
+			break;
+		}
+	}
+	c = &sh->clients[victim];
+	if (c->used)
+		unlink_bucket(sh, victim);
+	snprintf(c->address, sizeof(c->address), "%s", address);
+	c->hash = hash;
+	c->connections = 0;
+	c->tokens = capacity;
+	c->refilled = now_ms();
+	c->used = 1;
+	c->next = *bucket;
+	*bucket = victim;
+	touch(sh, victim);
+	return c;
+}
+
+static shard* shard_of(const char* address, uint32_t* hash) {
+	*hash = hash_string(address, strlen(address));
+	return &shards[(*hash >> 16) % RATELIMIT_SHARDS];
+}
+
+int ratelimit_connected(const char* address) {
+	uint32_t hash;
+	shard* sh;
+	client* c;
+	int ok = 1;
+	if (!shards)
+		return 1;
+	sh = shard_of(address, &hash);
+	mutex_lock(&sh->lock);
+	c = find(sh, address, hash, 1);
+	c->connections++;
+	if (max_connections && c->connections > max_connections)
+		ok = 0;
+	mutex_unlock(&sh->lock);
+	if (!ok)
+		atomic_inc(&refused);
+	return ok;
+}
+
+void ratelimit_closed(const char* address) {
+	uint32_t hash;
+	shard* sh;
+	client* c;
+	if (!shards)
+		return;
+	sh = shard_of(address, &hash);
+	mutex_lock(&sh->lock);
+	c = find(sh, address, hash, 0);
+	// the client may have been evicted and seen again since
+	if (c && c->connections > 0)
+		c->connections--;
+	mutex_unlock(&sh->lock);
+}
+
+int ratelimit_request(const char* address) {
+	uint32_t hash;
+	uint64_t now;
+	shard* sh;
+	client* c;
+	int ok = 1;
+	if (!shards || !rate)
+		return 1;
+	sh = shard_of(address, &hash);
+	now = now_ms();
+	mutex_lock(&sh->lock);
+	c = find(sh, address, hash, 1);
+	// a millisecond refills `rate` thousandths of a request
+	if (now > c->refilled) {
+		uint64_t tokens = c->tokens + (now - c->refilled) * rate;
+		c->tokens = tokens > capacity ? capacity : (uint32_t)tokens;
+		c->refilled = now;
+	}
+	if (c->tokens >= 1000)
+		c->tokens -= 1000;
+	else
+		ok = 0;
+	mutex_unlock(&sh->lock);
+	if (!ok)
+		atomic_inc(&rejected);
+	return ok;
+}
+
+void ratelimit_reject(sb_Stream* s) {
+	sb_send_raw(s, reject_head, sizeof(reject_head) - 1, REJECT_BODY, sizeof(REJECT_BODY) - 1, NULL, NULL);
+}
+
+int ratelimit_stats(buffer* b) {
+	char line[128];
+	sprintf(line, "rate-limited %d\nconnections-refused %d\n", atomic_load_int(&rejected), atomic_load_int(&refused));
+	return buffer_append_str(b, line);
+}
+
+void ratelimit_free() {
+	if (!shards)
+		return;
+	for (int i = 0; i < RATELIMIT_SHARDS; i++)
+		mutex_destroy(&shards[i].lock);
+	free(shards);
+	shards = NULL;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "sandbird/sandbird.h"
+#include "buffer.h"
+
+// per client address accounting: a token bucket for the request rate and a count of
+// open connections. clients live in a fixed-size table, the least recently seen one
+// making way for a new one once it is full, so memory stays bounded however many
+// addresses show up. a limit of 0 means no limit.
+void ratelimit_set_rate(unsigned per_second);
+void ratelimit_set_connections(int max);
+// allocates the table if any limit is set; returns 0 if that fails
+int ratelimit_init();
+
+// returns 0 if the client has too many connections open; either way ratelimit_closed must follow
+int ratelimit_connected(const char* address);
+void ratelimit_closed(const char* address);
+// returns 0 if the client is over its request rate
+int ratelimit_request(const char* address);
+// answers with the prebuilt 429
+void ratelimit_reject(sb_Stream* s);
+int ratelimit_stats(buffer* b);
+void ratelimit_free();
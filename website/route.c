@@ -0,0 +1,296 @@
+#include <stdint.h>
+#include "route.h"
+#include "epoch.h"
+#include "file.h"
+#include "thread.h"
+
+#include "debugalloc.h"
+
+typedef struct exact_route exact_route;
+struct exact_route {
+	route r;
+	uint32_t hash;
+	size_t len;
+	exact_route* next;
+};
+
+// wildcard routes live in two tries: prefix routes keyed by the pattern up to
+// the '*', suffix routes keyed by the pattern after the '*' read backwards.
+typedef struct trie_node trie_node;
+struct trie_node {
+	unsigned char ch;
+	route* r;
+	trie_node* child;
+	trie_node* sibling;
+};
+
+static exact_route** exact_buckets = NULL;
+static size_t exact_cap = 0;
+static size_t exact_count = 0;
+static trie_node prefix_root;
+static trie_node suffix_root;
+static response* volatile not_found = NULL;
+
+static char* copy_str(const char* s) {
+	size_t len = strlen(s);
+	char* ret = malloc(len + 1);
+	if (ret)
+		memcpy(ret, s, len + 1);
+	return ret;
+}
+
+static int exact_grow() {
+	size_t cap = exact_cap ? exact_cap * 2 : 16;
+	exact_route** buckets = calloc(cap, sizeof(*buckets));
+	if (!buckets)
+		return 0;
+	for (size_t i = 0; i < exact_cap; i++) {
+		exact_route* er = exact_buckets[i];
+		while (er) {
+			exact_route* next = er->next;
+			er->next = buckets[er->hash & (cap - 1)];
+			buckets[er->hash & (cap - 1)] = er;
+			er = next;
+		}
+	}
+	free(exact_buckets);
+	exact_buckets = buckets;
+	exact_cap = cap;
+	return 1;
+}
+
+static route* exact_insert(const char* path) {
+	size_t len = strlen(path);
+	uint32_t hash = hash_string(path, len);
+	exact_route* er;
+	if (exact_count + 1 > exact_cap / 4 * 3 && !exact_grow())
+		return NULL;
+	for (er = exact_buckets[hash & (exact_cap - 1)]; er; er = er->next) {
+		if (er->hash == hash && er->len == len && !memcmp(er->r.pattern, path, len))
+			return &er->r;
+	}
+	er = calloc(1, sizeof(*er));
+	if (!er)
+		return NULL;
+	er->r.pattern = copy_str(path);
+	if (!er->r.pattern) {
+		free(er);
+		return NULL;
+	}
+	er->hash = hash;
+	er->len = len;
+	er->next = exact_buckets[hash & (exact_cap - 1)];
+	exact_buckets[hash & (exact_cap - 1)] = er;
+	exact_count++;
+	return &er->r;
+}
+
+static const route* exact_find(const char* path) {
+	size_t len;
+	uint32_t hash;
+	if (!exact_count)
+		return NULL;
+	len = strlen(path);
+	hash = hash_string(path, len);
+	for (exact_route* er = exact_buckets[hash & (exact_cap - 1)]; er; er = er->next) {
+		if (er->hash == hash && er->len == len && !memcmp(er->r.pattern, path, len))
+			return &er->r;
+	}
+	return NULL;
+}
+
+static trie_node* trie_child(trie_node* n, unsigned char ch, char create) {
+	trie_node* c;
+	for (c = n->child; c; c = c->sibling) {
+		if (c->ch == ch)
+			return c;
+	}
+	if (!create)
+		return NULL;
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->ch = ch;
+	c->sibling = n->child;
+	n->child = c;
+	return c;
+}
+
+// walks `len` bytes of `key` (backwards when `step` is -1) creating nodes on the way
+static route* trie_insert(trie_node* root, const char* key, size_t len, int step) {
+	trie_node* n = root;
+	const char* p = step > 0 ? key : key + len - 1;
+	for (size_t i = 0; i < len; i++, p += step) {
+		n = trie_child(n, (unsigned char)*p, 1);
+		if (!n)
+			return NULL;
+	}
+	if (!n->r)
+		n->r = calloc(1, sizeof(route));
+	return n->r;
+}
+
+static const route* trie_find(const trie_node* root, const char* key, size_t len, int step) {
+	const trie_node* n = root;
+	const route* best = root->r;
+	const char* p = step > 0 ? key : key + len - 1;
+	for (size_t i = 0; i < len; i++, p += step) {
+		n = trie_child((trie_node*)n, (unsigned char)*p, 0);
+		if (!n)
+			break;
+		if (n->r)
+			best = n->r;
+	}
+	return best;
+}
+
+static void trie_free(trie_node* n) {
+	trie_node* c = n->child;
+	while (c) {
+		trie_node* next = c->sibling;
+		trie_free(c);
+		free(c);
+		c = next;
+	}
+	if (n->r) {
+		free((char*)n->r->pattern);
+		free(n->r);
+	}
+	memset(n, 0, sizeof(*n));
+}
+
+static route* route_insert(const char* pattern) {
+	const char* star = strchr(pattern, '*');
+	route* r;
+	if (!star)
+		return exact_insert(pattern);
+	if (star == pattern)
+		r = trie_insert(&suffix_root, star + 1, strlen(star + 1), -1);
+	else if (star[1] == '\0')
+		r = trie_insert(&prefix_root, pattern, star - pattern, 1);
+	else
+		return NULL; // infix wildcards are not supported
+	if (r && !r->pattern) {
+		r->pattern = copy_str(pattern);
+		if (!r->pattern)
+			return NULL;
+	}
+	return r;
+}
+
+int route_add(const char* pattern, const char* content_type, route_handler handler) {
+	route* r = route_insert(pattern);
+	if (!r)
+		return 0;
+	r->content_type = content_type;
+	r->handler = handler;
+	return 1;
+}
+
+int route_add_static(const char* path, const char* content_type, const char* body, size_t len) {
+	route* r = exact_insert(path);
+	response* res;
+	if (!r)
+		return 0;
+	res = response_new(200, "Hello there", content_type, body, len);
+	if (!res)
+		return 0;
+	free((char*)body);
+	response_release(r->response);
+	r->content_type = content_type;
+	r->handler = NULL;
+	r->response = res;
+	return 1;
+}
+
+const route* route_match(const char* path) {
+	const route* r = exact_find(path);
+	size_t len;
+	if (r)
+		return r;
+	len = strlen(path);
+	r = trie_find(&suffix_root, path, len, -1);
+	if (r)
+		return r;
+	return trie_find(&prefix_root, path, len, 1);
+}
+
+// requests may be picking up the previous response concurrently, so it is retired
+// rather than released; streams still sending it keep it alive until they are done
+int route_set_not_found(const char* body, size_t len) {
+	response* res = NULL;
+	response* old = not_found;
+	if (body) {
+		res = response_new(404, "Not Found", "text/html", body, len);
+		if (!res)
+			return 0;
+		free((char*)body);
+	}
+	atomic_store_ptr((void* volatile*)&not_found, res);
+	if (old)
+		epoch_retire(response_release, old);
+	return 1;
+}
+
+// queues a prebuilt response, handing the caller's reference over to the stream
+static void send_held(sb_Stream* s, response* res) {
+	if (sb_send_raw(s, res->data, res->head_len, res->data + res->head_len, res->len - res->head_len, response_release, res))
+		response_release(res);
+}
+
+static void send_response(sb_Stream* s, response* res) {
+	atomic_inc(&res->refs);
+	send_held(s, res);
+}
+
+void route_not_found(sb_Stream* s) {
+	response* res = NULL;
+	if (epoch_enter()) {
+		res = (response*)atomic_load_ptr((void* volatile*)&not_found);
+		if (res)
+			atomic_inc(&res->refs);
+		epoch_exit();
+	}
+	if (res)
+		send_held(s, res);
+	else
+		sb_send_status(s, 404, "Not Found");
+}
+
+// sends the status line and the route's Content-Type, for handlers about to write a body
+void route_begin(sb_Stream* s, const route* r) {
+	sb_send_status(s, 200, "Hello there");
+	if (r->content_type)
+		sb_send_header(s, "Content-Type", r->content_type);
+}
+
+void route_dispatch(sb_Event* e) {
+	const route* r = route_match(e->path);
+	if (r && r->handler) {
+		if (r->handler(e, r))
+			return;
+	} else if (r) {
+		send_response(e->stream, r->response);
+		return;
+	}
+	route_not_found(e->stream);
+}
+
+void route_clear() {
+	for (size_t i = 0; i < exact_cap; i++) {
+		exact_route* er = exact_buckets[i];
+		while (er) {
+			exact_route* next = er->next;
+			free((char*)er->r.pattern);
+			response_release(er->r.response);
+			free(er);
+			er = next;
+		}
+	}
+	free(exact_buckets);
+	exact_buckets = NULL;
+	exact_cap = exact_count = 0;
+	trie_free(&prefix_root);
+	trie_free(&suffix_root);
+	route_set_not_found(NULL, 0);
+}
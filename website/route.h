@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include "sandbird/sandbird.h"
+#include "http.h"
+
+typedef struct route route;
+// handlers return 0 before writing anything to have the not found response sent instead
+typedef int (*route_handler)(sb_Event* e, const route* r);
+
+// patterns are either exact ("/"), extension/suffix ("*.md") or prefix ("/static/*").
+// exact routes win over suffix routes, which win over prefix routes; within a
+// kind the longest match wins.
+struct route {
+	const char* pattern;
+	const char* content_type;
+	route_handler handler;
+	response* response; // prebuilt response, served without calling the handler
+};
+
+int route_add(const char* pattern, const char* content_type, route_handler handler);
+// static routes take ownership of `body` on success, serving it as a prebuilt response
+int route_add_static(const char* path, const char* content_type, const char* body, size_t len);
+// takes ownership of `body` on success, served with a 404 for anything no route handles
+int route_set_not_found(const char* body, size_t len);
+const route* route_match(const char* path);
+void route_begin(sb_Stream* s, const route* r);
+void route_dispatch(sb_Event* e);
+// sends the not found response, for requests answered after their handler returned
+void route_not_found(sb_Stream* s);
+void route_clear();
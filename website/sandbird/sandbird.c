@@ -20,6 +20,9 @@
   #include <ws2tcpip.h>
   #include <windows.h>
 #else
+  #if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE /* accept4 */
+  #endif
   #ifndef _POSIX_C_SOURCE
     #define _POSIX_C_SOURCE 200809L
   #endif
@@ -29,11 +32,17 @@
   #include <sys/types.h>
   #include <sys/socket.h>
   #include <sys/select.h>
+  #include <sys/uio.h>
+  #ifdef __linux__
+    #include <sys/sendfile.h>
+    #include <sys/eventfd.h>
+  #endif
   #include <arpa/inet.h>
   #include <netinet/in.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
@@ -78,8 +87,13 @@
 #endif
 
 typedef struct sb_Buffer sb_Buffer;
+typedef struct sb_Slice sb_Slice;
 
 struct sb_Buffer { char *s; size_t len, cap; };
+struct sb_Slice { const char *s; size_t len; };
+
+#define SB_MAX_RAW 3
+#define SB_PAUSE_MS 10
 
 struct sb_Stream {
   int state;                  /* Current state of the stream */
@@ -93,9 +107,28 @@ struct sb_Stream {
   sb_Buffer recv_buf;         /* Data received from client */
   sb_Buffer send_buf;         /* Data waiting to be sent to client */
   FILE *send_fp;              /* File currently being sent to client */
+  sb_Slice raw[SB_MAX_RAW];   /* Caller-owned data queued by sb_send_raw() */
+  int raw_idx, raw_cnt;       /* Next and total number of raw slices */
+  char raw_tail[128];         /* Per-request header lines sent after raw head */
+  int raw_fd;                 /* Caller-owned file sent after the raw slices */
+  size_t raw_fd_off;          /* Offset of the next byte to send from raw_fd */
+  size_t raw_fd_len;          /* Bytes left to send from raw_fd */
+  sb_Release raw_release;     /* Called once the raw data is no longer used */
+  void *raw_udata;            /* Argument to raw_release */
+  sb_Resume resume;           /* Called on the server's thread by sb_resume() */
+  void *resume_udata;         /* Argument to resume */
+  sb_Stream *resume_next;     /* Next stream in the server's resumed queue */
+  size_t pending;             /* Bytes counted in the server's pending total */
   sb_Stream *next;            /* Next stream in linked list */
 };
 
+typedef struct sb_Handoff sb_Handoff;
+
+struct sb_Handoff {
+  sb_Socket sockfd;           /* Accepted socket, already non-blocking */
+  sb_Handoff *next;
+};
+
 struct sb_Server {
   sb_Stream *streams;         /* Linked list of all streams */
   sb_Handler handler;         /* Event handler callback function */
@@ -105,15 +138,25 @@ struct sb_Server {
   time_t timeout;             /* Stream no-activity timeout */
   time_t max_lifetime;        /* Maximum time a stream can exist */
   size_t max_request_size;    /* Maximum request size in bytes */
+  time_t date_time;           /* Time `date` was formatted for */
+  char date[64];              /* IMF-fixdate of date_time for Date headers */
+  sb_Handoff *handoff;        /* Sockets passed in by sb_hand_off(), newest first */
+  sb_Stream *resumed;         /* Streams passed back by sb_resume(), newest first */
+  int wake_fd[2];             /* Wakeup for the queues, read and write ends; -1 if none */
+  int load;                   /* Number of open streams, read by other threads */
+  size_t pending;             /* Bytes queued on all streams, read by other threads */
+  int accepting;              /* Whether to take new connections from sockfd */
 };
 
 enum {
   STATE_RECEIVING_HEADER,
   STATE_RECEIVING_REQUEST,
+  STATE_DEFERRED,
   STATE_SENDING_STATUS,
   STATE_SENDING_HEADER,
   STATE_SENDING_DATA,
   STATE_SENDING_FILE,
+  STATE_SENDING_RAW,
   STATE_CLOSING
 };
 
@@ -133,6 +176,46 @@ static void set_socket_non_blocking(sb_Socket sockfd) {
 }
 
 
+/* Accepts a connection as a non-blocking socket, in a single call where the
+ * platform allows it */
+static sb_Socket accept_non_blocking(sb_Socket sockfd) {
+#ifdef __linux__
+  return accept4(sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  sb_Socket res = accept(sockfd, NULL, NULL);
+  if (res != INVALID_SOCKET) set_socket_non_blocking(res);
+  return res;
+#endif
+}
+
+
+static int atomic_add(int *p, int n) {
+#ifdef _WIN32
+  return InterlockedExchangeAdd((volatile LONG*) p, n);
+#else
+  return __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+#endif
+}
+
+
+static void store_size(size_t *p, size_t v) {
+#ifdef _WIN32
+  *(volatile size_t*) p = v;
+#else
+  __atomic_store_n(p, v, __ATOMIC_RELAXED);
+#endif
+}
+
+
+static size_t load_size(size_t *p) {
+#ifdef _WIN32
+  return *(volatile size_t*) p;
+#else
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+
 static int get_socket_address(sb_Socket sockfd, char *dst) {
   int err;
   union { struct sockaddr sa; struct sockaddr_storage sas;
@@ -152,6 +235,21 @@ static int get_socket_address(sb_Socket sockfd, char *dst) {
 }
 
 
+static void format_http_date(char *dst, size_t size, time_t t) {
+  static const char days[] = "SunMonTueWedThuFriSat";
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  struct tm tm;
+#ifdef _WIN32
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  snprintf(dst, size, "%.3s, %02d %.3s %04d %02d:%02d:%02d GMT",
+          days + tm.tm_wday * 3, tm.tm_mday, months + tm.tm_mon * 3,
+          tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+
 static unsigned str_to_uint(const char *str) {
   unsigned n;
   if (!str || sscanf(str, "%u", &n) != 1) return 0;
@@ -241,6 +339,7 @@ const char *sb_error_str(int code) {
     case SB_ECANTOPEN   : return "cannot open file";
     case SB_ENOTFOUND   : return "not found";
     case SB_EFDTOOBIG   : return "got socket fd larger than FD_SETSIZE";
+    case SB_EUNSUPPORTED: return "not supported on this platform";
     default             : return "unknown";
   }
 }
@@ -387,8 +486,8 @@ static sb_Stream *sb_stream_new(sb_Server *srv, sb_Socket sockfd) {
   st->server = srv;
   st->init_time = srv->now;
   st->last_activity = srv->now;
-  set_socket_non_blocking(sockfd);
   get_socket_address(sockfd, st->address);
+  atomic_add(&srv->load, 1);
   return st;
 }
 
@@ -414,6 +513,20 @@ static int sb_stream_emit(sb_Stream *st, sb_Event *e) {
 }
 
 
+/* Brings the server's pending total up to date with what the stream still
+ * has queued; only ever called on the server's own thread */
+static void sb_stream_account(sb_Stream *st) {
+  sb_Server *srv = st->server;
+  size_t n = st->send_buf.len + st->raw_fd_len;
+  int i;
+  for (i = st->raw_idx; i < st->raw_cnt; i++) n += st->raw[i].len;
+  if (n != st->pending) {
+    store_size(&srv->pending, srv->pending - st->pending + n);
+    st->pending = n;
+  }
+}
+
+
 static void sb_stream_destroy(sb_Stream *st) {
   sb_Event e;
   /* Emit close event */
@@ -422,6 +535,9 @@ static void sb_stream_destroy(sb_Stream *st) {
   /* Clean up */
   close(st->sockfd);
   if (st->send_fp) fclose(st->send_fp);
+  if (st->raw_release) st->raw_release(st->raw_udata);
+  atomic_add(&st->server->load, -1);
+  store_size(&st->server->pending, st->server->pending - st->pending);
   sb_buffer_deinit(&st->recv_buf);
   sb_buffer_deinit(&st->send_buf);
   free(st);
@@ -510,6 +626,67 @@ handle_request:
 }
 
 
+static int sb_stream_send_raw(sb_Stream *st) {
+  int sz;
+#ifdef _WIN32
+  sb_Slice *sl = &st->raw[st->raw_idx];
+  sz = send(st->sockfd, sl->s, (int) sl->len, 0);
+#else
+  struct iovec iov[SB_MAX_RAW];
+  int i, n = 0;
+  for (i = st->raw_idx; i < st->raw_cnt; i++, n++) {
+    iov[n].iov_base = (void*) st->raw[i].s;
+    iov[n].iov_len = st->raw[i].len;
+  }
+  sz = writev(st->sockfd, iov, n);
+#endif
+  if (sz <= 0) {
+    /* Disconnected? */
+    if (errno != EWOULDBLOCK) {
+      sb_stream_close(st);
+    }
+    return SB_ESUCCESS;
+  }
+
+  /* Skip past sent bytes, including slices which are now empty */
+  while (st->raw_idx < st->raw_cnt) {
+    sb_Slice *sl = &st->raw[st->raw_idx];
+    if ((size_t) sz < sl->len) {
+      sl->s += sz;
+      sl->len -= sz;
+      break;
+    }
+    sz -= (int) sl->len;
+    st->raw_idx++;
+  }
+
+  /* Update last_activity */
+  st->last_activity = st->server->now;
+  return SB_ESUCCESS;
+}
+
+
+static int sb_stream_send_raw_fd(sb_Stream *st) {
+#ifdef __linux__
+  off_t off = (off_t) st->raw_fd_off;
+  ssize_t sz = sendfile(st->sockfd, st->raw_fd, &off, st->raw_fd_len);
+  if (sz <= 0) {
+    /* Disconnected, or the file is shorter than promised? */
+    if (sz == 0 || errno != EWOULDBLOCK) {
+      sb_stream_close(st);
+    }
+    return SB_ESUCCESS;
+  }
+  st->raw_fd_off += sz;
+  st->raw_fd_len -= sz;
+
+  /* Update last_activity */
+  st->last_activity = st->server->now;
+#endif
+  return SB_ESUCCESS;
+}
+
+
 static int sb_stream_send(sb_Stream *st) {
   if (st->send_buf.len > 0) {
     int sz;
@@ -542,6 +719,12 @@ send_data:
     fclose(st->send_fp);
     st->send_fp = NULL;
 
+  } else if (st->raw_idx < st->raw_cnt) {
+    return sb_stream_send_raw(st);
+
+  } else if (st->raw_fd_len > 0) {
+    return sb_stream_send_raw_fd(st);
+
   } else {
     /* No more data left -- disconnect */
     sb_stream_close(st);
@@ -624,6 +807,59 @@ fail:
 }
 
 
+/* Sends a complete response from memory owned by the caller without copying
+ * it. `head` holds the status line and header fields, each terminated by
+ * CRLF; the Date and Connection fields are added per request. Both `head` and
+ * `body` must stay valid until `release` (if non-NULL) is called with
+ * `udata`, which happens once the stream is done with them. */
+int sb_send_raw(sb_Stream *st, const void *head, size_t head_len,
+                const void *body, size_t body_len,
+                sb_Release release, void *udata) {
+  sb_Server *srv = st->server;
+  if (st->state != STATE_SENDING_STATUS) {
+    return SB_EBADSTATE;
+  }
+  /* The date only changes once a second, so it is formatted at most that often */
+  if (srv->date_time != srv->now || !srv->date[0]) {
+    format_http_date(srv->date, sizeof(srv->date), srv->now);
+    srv->date_time = srv->now;
+  }
+  st->raw[0].s = head;
+  st->raw[0].len = head_len;
+  st->raw[1].s = st->raw_tail;
+  st->raw[1].len = sprintf(st->raw_tail,
+                           "Date: %s\r\nConnection: close\r\n\r\n", srv->date);
+  st->raw[2].s = body;
+  st->raw[2].len = body_len;
+  st->raw_idx = 0;
+  st->raw_cnt = 3;
+  st->raw_release = release;
+  st->raw_udata = udata;
+  st->state = STATE_SENDING_RAW;
+  return SB_ESUCCESS;
+}
+
+
+/* Like sb_send_raw(), but the body is `len` bytes of the file `fd` starting at
+ * `offset`, which the kernel copies straight into the socket with sendfile().
+ * The file must not shrink before `release` is called. Only available on
+ * Linux, elsewhere SB_EUNSUPPORTED is returned and nothing is queued. */
+int sb_send_raw_fd(sb_Stream *st, const void *head, size_t head_len,
+                   int fd, size_t offset, size_t len,
+                   sb_Release release, void *udata) {
+#ifdef __linux__
+  int err = sb_send_raw(st, head, head_len, NULL, 0, release, udata);
+  if (err) return err;
+  st->raw_fd = fd;
+  st->raw_fd_off = offset;
+  st->raw_fd_len = len;
+  return SB_ESUCCESS;
+#else
+  return SB_EUNSUPPORTED;
+#endif
+}
+
+
 int sb_write(sb_Stream *st, const void *data, size_t len) {
   if (st->state < STATE_SENDING_DATA) {
     int err = sb_stream_finalize_header(st);
@@ -788,10 +1024,8 @@ fail:
  * Server
  *===========================================================================*/
 
-sb_Server *sb_new_server(const sb_Options *opt) {
+static sb_Server *sb_server_alloc(const sb_Options *opt) {
   sb_Server *srv;
-  struct addrinfo hints, *ai = NULL;
-  int err, optval;
 
 #ifdef _WIN32
   { WSADATA dat; WSAStartup(MAKEWORD(2, 2), &dat); }
@@ -802,14 +1036,56 @@ sb_Server *sb_new_server(const sb_Options *opt) {
 
   /* Create server object */
   srv = malloc( sizeof(*srv) );
-  if (!srv) goto fail;
+  if (!srv) return NULL;
   memset(srv, 0, sizeof(*srv));
   srv->sockfd = INVALID_SOCKET;
+  srv->wake_fd[0] = srv->wake_fd[1] = -1;
+  srv->accepting = 1;
   srv->handler = opt->handler;
   srv->udata = opt->udata;
   srv->timeout = opt->timeout ? str_to_uint(opt->timeout) : 30000;
   srv->max_request_size = str_to_uint(opt->max_request_size);
   srv->max_lifetime = str_to_uint(opt->max_lifetime);
+  return srv;
+}
+
+
+#ifndef _WIN32
+static int sb_server_open_wake(sb_Server *srv) {
+#ifdef __linux__
+  srv->wake_fd[0] = srv->wake_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return srv->wake_fd[0] != -1;
+#else
+  if (pipe(srv->wake_fd)) {
+    srv->wake_fd[0] = srv->wake_fd[1] = -1;
+    return 0;
+  }
+  set_socket_non_blocking(srv->wake_fd[0]);
+  set_socket_non_blocking(srv->wake_fd[1]);
+  return 1;
+#endif
+}
+
+
+/* Wakes the server's poll once something was pushed onto an empty queue */
+static void sb_server_wake(sb_Server *srv) {
+#ifdef __linux__
+  uint64_t one = 1;
+  if (write(srv->wake_fd[1], &one, sizeof(one)) < 0) { /* Already signalled */ }
+#else
+  if (write(srv->wake_fd[1], "", 1) < 0) { /* Pipe full, already signalled */ }
+#endif
+}
+#endif
+
+
+sb_Server *sb_new_server(const sb_Options *opt) {
+  sb_Server *srv;
+  struct addrinfo hints, *ai = NULL;
+  int err, optval;
+
+  srv = sb_server_alloc(opt);
+  if (!srv) goto fail;
 
   /* Get addrinfo */
   memset(&hints, 0, sizeof(hints));
@@ -848,22 +1124,274 @@ fail:
 }
 
 
+/* A worker has no listening socket of its own: it serves the connections
+ * passed to it with sb_hand_off(), typically by a thread calling sb_accept()
+ * on a listening server. Not available on Windows. */
+sb_Server *sb_new_worker(const sb_Options *opt) {
+#ifdef _WIN32
+  return NULL;
+#else
+  sb_Server *srv = sb_server_alloc(opt);
+  if (!srv) return NULL;
+  if (!sb_server_open_wake(srv)) {
+    sb_close_server(srv);
+    return NULL;
+  }
+  return srv;
+#endif
+}
+
+
 void sb_close_server(sb_Server *srv) {
+  sb_Stream *st;
+
+  /* Give resumed streams their callbacks, which may own resources, before
+   * the streams go */
+  while ((st = srv->resumed)) {
+    srv->resumed = st->resume_next;
+    st->state = STATE_SENDING_STATUS;
+    st->resume(st, st->resume_udata);
+  }
+
   /* Destroy all streams */
   while (srv->streams) {
-    sb_Stream *st = srv->streams;
+    st = srv->streams;
     srv->streams = st->next;
     sb_stream_destroy(st);
   }
 
+  /* Close sockets handed over but never taken */
+  while (srv->handoff) {
+    sb_Handoff *h = srv->handoff;
+    srv->handoff = h->next;
+    close(h->sockfd);
+    free(h);
+  }
+
   /* Clean up */
   if (srv->sockfd != INVALID_SOCKET) {
     close(srv->sockfd);
   }
+  if (srv->wake_fd[0] != -1) close(srv->wake_fd[0]);
+  if (srv->wake_fd[1] != -1 && srv->wake_fd[1] != srv->wake_fd[0]) {
+    close(srv->wake_fd[1]);
+  }
   free(srv);
 }
 
 
+/* Waits up to `timeout` milliseconds for a connection on a listening server
+ * and accepts it as a non-blocking socket. Returns -1 if none arrived. */
+int sb_accept(sb_Server *srv, int timeout) {
+  sb_Socket sockfd;
+  fd_set fds;
+  struct timeval tv;
+
+  /* While paused, check back shortly rather than after the full timeout */
+  if (!srv->accepting) {
+    if (timeout > SB_PAUSE_MS) timeout = SB_PAUSE_MS;
+#ifdef _WIN32
+    Sleep(timeout);
+#else
+    tv.tv_sec = 0;
+    tv.tv_usec = timeout * 1000;
+    select(0, NULL, NULL, NULL, &tv);
+#endif
+    return -1;
+  }
+
+  sockfd = accept_non_blocking(srv->sockfd);
+  if (sockfd != INVALID_SOCKET) return (int) sockfd;
+
+  FD_ZERO(&fds);
+  FD_SET(srv->sockfd, &fds);
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+  if (select(srv->sockfd + 1, &fds, NULL, NULL, &tv) <= 0) return -1;
+
+  sockfd = accept_non_blocking(srv->sockfd);
+  return sockfd == INVALID_SOCKET ? -1 : (int) sockfd;
+}
+
+
+/* Passes an accepted non-blocking socket to a worker; safe to call from any
+ * thread. The worker owns the socket from here on. */
+int sb_hand_off(sb_Server *srv, int sockfd) {
+#ifdef _WIN32
+  return SB_EUNSUPPORTED;
+#else
+  sb_Handoff *h, *head;
+  if (srv->wake_fd[1] == -1) return SB_EBADSTATE;
+  h = malloc( sizeof(*h) );
+  if (!h) return SB_EOUTOFMEM;
+  h->sockfd = sockfd;
+
+  /* Push onto the worker's queue; it takes the whole queue at once, so there
+   * is only ever one consumer and no ABA problem */
+  head = __atomic_load_n(&srv->handoff, __ATOMIC_RELAXED);
+  do {
+    h->next = head;
+  } while (!__atomic_compare_exchange_n(&srv->handoff, &head, h, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  /* The queue was not empty, so a wakeup is already pending */
+  if (!head) sb_server_wake(srv);
+  return SB_ESUCCESS;
+#endif
+}
+
+
+/* Number of streams the server currently has open; safe to call from any
+ * thread */
+int sb_load(sb_Server *srv) {
+  return atomic_add(&srv->load, 0);
+}
+
+
+/* Bytes the server's streams have queued but not yet sent, as of its last
+ * poll; safe to call from any thread */
+size_t sb_pending(sb_Server *srv) {
+  return load_size(&srv->pending);
+}
+
+
+/* Stops or resumes taking connections from a listening server, leaving new
+ * ones waiting in the kernel's backlog meanwhile. Call on the thread that
+ * polls the server or calls sb_accept() on it. */
+void sb_set_accepting(sb_Server *srv, int accepting) {
+  srv->accepting = accepting;
+}
+
+
+/* Called from a request handler to leave the request unanswered for now,
+ * typically while another thread does work that could block. The stream is
+ * neither polled nor timed out until it is passed to sb_resume(), which must
+ * happen exactly once. Not available on Windows. */
+int sb_defer(sb_Stream *st) {
+  if (st->state != STATE_SENDING_STATUS) return SB_EBADSTATE;
+#ifdef _WIN32
+  return SB_EUNSUPPORTED;
+#else
+  /* A listening server opens its wakeup on first use rather than when it is
+   * created, so that processes forked after that do not share one */
+  if (st->server->wake_fd[1] == -1 && !sb_server_open_wake(st->server)) {
+    return SB_EUNSUPPORTED;
+  }
+  st->state = STATE_DEFERRED;
+  return SB_ESUCCESS;
+#endif
+}
+
+
+/* Passes a deferred stream back to its server; safe to call from any thread.
+ * `fn` is called on the server's thread to send the response. */
+int sb_resume(sb_Stream *st, sb_Resume fn, void *udata) {
+#ifdef _WIN32
+  return SB_EUNSUPPORTED;
+#else
+  sb_Server *srv = st->server;
+  sb_Stream *head;
+  if (st->state != STATE_DEFERRED) return SB_EBADSTATE;
+  st->resume = fn;
+  st->resume_udata = udata;
+
+  /* Same queue discipline as sb_hand_off() */
+  head = __atomic_load_n(&srv->resumed, __ATOMIC_RELAXED);
+  do {
+    st->resume_next = head;
+  } while (!__atomic_compare_exchange_n(&srv->resumed, &head, st, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  if (!head) sb_server_wake(srv);
+  return SB_ESUCCESS;
+#endif
+}
+
+
+static int sb_server_add_stream(sb_Server *srv, sb_Socket sockfd) {
+  sb_Stream *st;
+  sb_Event e;
+
+#ifdef _WIN32
+  /* As the fd_set on windows is an array rather than a bitset, an fd
+   * value can never be too large for it; thus this check is omitted */
+#else
+  /* Check FD size, error if it is larger than FD_SETSIZE */
+  if (sockfd > FD_SETSIZE) {
+    close(sockfd);
+    return SB_EFDTOOBIG;
+  }
+#endif
+
+  /* Init new stream */
+  st = sb_stream_new(srv, sockfd);
+  if (!st) {
+    close(sockfd);
+    return SB_EOUTOFMEM;
+  }
+
+  /* Push stream to list */
+  st->next = srv->streams;
+  srv->streams = st;
+
+  /* Do `connect` event */
+  e.type = SB_EV_CONNECT;
+  return sb_stream_emit(st, &e);
+}
+
+
+#ifndef _WIN32
+static int sb_server_take_queued(sb_Server *srv) {
+  sb_Handoff *h, *list = NULL;
+  sb_Stream *st, *resumed = NULL;
+  char buf[64];
+  int err = SB_ESUCCESS;
+
+  /* Drain the wakeup before taking the queues so nothing goes unnoticed */
+  while (read(srv->wake_fd[0], buf, sizeof(buf)) > 0);
+
+  /* Resumed streams, in the order they were resumed */
+  st = __atomic_exchange_n(&srv->resumed, NULL, __ATOMIC_ACQUIRE);
+  while (st) {
+    sb_Stream *next = st->resume_next;
+    st->resume_next = resumed;
+    resumed = st;
+    st = next;
+  }
+  while (resumed) {
+    st = resumed;
+    resumed = st->resume_next;
+    st->resume_next = NULL;
+    st->state = STATE_SENDING_STATUS;
+    st->last_activity = srv->now;
+    st->resume(st, st->resume_udata);
+    sb_stream_account(st);
+  }
+
+  h = __atomic_exchange_n(&srv->handoff, NULL, __ATOMIC_ACQUIRE);
+
+  /* Reverse into arrival order */
+  while (h) {
+    sb_Handoff *next = h->next;
+    h->next = list;
+    list = h;
+    h = next;
+  }
+
+  while (list) {
+    h = list;
+    list = h->next;
+    if (err) {
+      close(h->sockfd);
+    } else {
+      err = sb_server_add_stream(srv, h->sockfd);
+    }
+    free(h);
+  }
+  return err;
+}
+#endif
+
+
 int sb_poll_server(sb_Server *srv, int timeout) {
   sb_Stream *st, **st_next;
   fd_set fds_read, fds_write;
@@ -875,11 +1403,20 @@ int sb_poll_server(sb_Server *srv, int timeout) {
   FD_ZERO(&fds_read);
   FD_ZERO(&fds_write);
 
-  /* Add server sockfd to fd_set */
-  FD_SET(srv->sockfd, &fds_read);
+  /* Add server sockfd, unless paused, and the wakeup fd to fd_set */
+  if (srv->sockfd != INVALID_SOCKET && srv->accepting) {
+    FD_SET(srv->sockfd, &fds_read);
+  }
+#ifndef _WIN32
+  if (srv->wake_fd[0] != -1) {
+    FD_SET(srv->wake_fd[0], &fds_read);
+    if (srv->wake_fd[0] > max_fd) max_fd = srv->wake_fd[0];
+  }
+#endif
 
   /* Add streams to fd_sets */
   for (st = srv->streams; st; st = st->next) {
+    if (st->state == STATE_DEFERRED) continue;
     if (st->state >= STATE_SENDING_STATUS) {
       FD_SET(st->sockfd, &fds_write);
     } else {
@@ -915,12 +1452,16 @@ int sb_poll_server(sb_Server *srv, int timeout) {
       if (err) return err;
     }
 
-    /* Check stream against timeout, max request length and max lifetime */
+    sb_stream_account(st);
+
+    /* Check stream against timeout, max request length and max lifetime;
+     * a deferred stream is left alone until it is resumed */
     if (
+      st->state != STATE_DEFERRED && (
       (srv->timeout && srv->now - st->last_activity > srv->timeout / 1000) ||
       (srv->max_lifetime &&
        srv->now - st->init_time > srv->max_lifetime / 1000) ||
-      (srv->max_request_size && st->recv_buf.len >= srv->max_request_size)
+      (srv->max_request_size && st->recv_buf.len >= srv->max_request_size))
     ) {
       sb_stream_close(st);
     }
@@ -936,39 +1477,22 @@ int sb_poll_server(sb_Server *srv, int timeout) {
     st_next = &(*st_next)->next;
   }
 
-  /* Handle new streams */
-  if (FD_ISSET(srv->sockfd, &fds_read)) {
-    sb_Event e;
-    sb_Socket sockfd;
-
-    /* Accept connections */
-    while ( (sockfd = accept(srv->sockfd, NULL, NULL)) != INVALID_SOCKET ) {
-
-#ifdef _WIN32
-      /* As the fd_set on windows is an array rather than a bitset, an fd
-       * value can never be too large for it; thus this check is omitted */
-#else
-      /* Check FD size, error if it is larger than FD_SETSIZE */
-      if (sockfd > FD_SETSIZE) {
-        close(sockfd);
-        return SB_EFDTOOBIG;
-      }
+  /* Handle streams handed over or resumed by other threads */
+#ifndef _WIN32
+  if (srv->wake_fd[0] != -1 && FD_ISSET(srv->wake_fd[0], &fds_read)) {
+    err = sb_server_take_queued(srv);
+    if (err) return err;
+  }
 #endif
 
-      /* Init new stream */
-      st = sb_stream_new(srv, sockfd);
-      if (!st) {
-        close(sockfd);
-        return SB_EOUTOFMEM;
-      }
-
-      /* Push stream to list */
-      st->next = srv->streams;
-      srv->streams = st;
+  /* Handle new streams */
+  if (srv->sockfd != INVALID_SOCKET && FD_ISSET(srv->sockfd, &fds_read)) {
+    sb_Socket sockfd;
 
-      /* Do `connect` event */
-      e.type = SB_EV_CONNECT;
-      err = sb_stream_emit(st, &e);
+    /* Accept connections; a `connect` handler may pause accepting */
+    while ( srv->accepting &&
+            (sockfd = accept_non_blocking(srv->sockfd)) != INVALID_SOCKET ) {
+      err = sb_server_add_stream(srv, sockfd);
       if (err) return err;
     }
   }
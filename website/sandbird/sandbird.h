@@ -23,6 +23,8 @@ typedef struct sb_Stream  sb_Stream;
 typedef struct sb_Event   sb_Event;
 typedef struct sb_Options sb_Options;
 typedef int (*sb_Handler)(sb_Event*);
+typedef void (*sb_Release)(void*);
+typedef void (*sb_Resume)(sb_Stream*, void*);
 
 struct sb_Event {
   int type;
@@ -53,7 +55,8 @@ enum {
   SB_EBADRESULT   = -5,
   SB_ECANTOPEN    = -6,
   SB_ENOTFOUND    = -7,
-  SB_EFDTOOBIG    = -8
+  SB_EFDTOOBIG    = -8,
+  SB_EUNSUPPORTED = -9
 };
 
 enum {
@@ -69,11 +72,25 @@ enum {
 
 const char *sb_error_str(int code);
 sb_Server *sb_new_server(const sb_Options *opt);
+sb_Server *sb_new_worker(const sb_Options *opt);
 void sb_close_server(sb_Server *srv);
 int sb_poll_server(sb_Server *srv, int timeout);
+int sb_accept(sb_Server *srv, int timeout);
+int sb_hand_off(sb_Server *srv, int sockfd);
+int sb_load(sb_Server *srv);
+size_t sb_pending(sb_Server *srv);
+void sb_set_accepting(sb_Server *srv, int accepting);
+int sb_defer(sb_Stream *st);
+int sb_resume(sb_Stream *st, sb_Resume fn, void *udata);
 int sb_send_status(sb_Stream *st, int code, const char *msg);
 int sb_send_header(sb_Stream *st, const char *field, const char *val);
 int sb_send_file(sb_Stream *st, const char *filename);
+int sb_send_raw(sb_Stream *st, const void *head, size_t head_len,
+                const void *body, size_t body_len,
+                sb_Release release, void *udata);
+int sb_send_raw_fd(sb_Stream *st, const void *head, size_t head_len,
+                   int fd, size_t offset, size_t len,
+                   sb_Release release, void *udata);
 int sb_write(sb_Stream *st, const void *data, size_t len);
 int sb_vwritef(sb_Stream *st, const char *fmt, va_list args);
 int sb_writef(sb_Stream *st, const char *fmt, ...);
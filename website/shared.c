@@ -0,0 +1,680 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "shared.h"
+#include "file.h"
+#include "http.h"
+#include "io.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "debugalloc.h"
+
+#ifdef _WIN32
+
+int shared_init(size_t bytes) {
+	return 0;
+}
+
+void shared_set_stale_window(unsigned seconds) {
+}
+
+int shared_get(const char* key, const char* content_type, page_renderer render, shared_page* out) {
+	return 0;
+}
+
+int shared_try_get(const char* key, shared_page* out) {
+	return 0;
+}
+
+void shared_release(void* pin) {
+}
+
+void shared_revalidate(page_source source, uint32_t templates) {
+}
+
+void shared_collect() {
+}
+
+void shared_forget(int pid) {
+}
+
+void shared_free() {
+}
+
+#else
+
+#define SHARED_SLOTS 4096
+#define SHARED_WAIT_MS 5000 // how long to wait for another worker's render before doing it locally
+#define SHARED_READERS 256  // worker processes that can hold pages at once
+#define SHARED_EXTENTS 4096 // free and retired arena ranges kept track of
+
+// a published page, replaced as a whole under the slot's sequence counter
+typedef struct version {
+	uint64_t head_off;
+	uint64_t head_len;
+	uint64_t body_off;
+	uint64_t body_len;
+	int64_t mtime;
+	int64_t rendered; // when the render began
+	int64_t stale_since;
+	uint32_t templates;
+	char present;
+	char stale;
+} version;
+
+// a slot belongs to one key forever once `hash` is set. readers never lock: they
+// retry while `seq` is odd or changed under them.
+typedef struct slot {
+	uint32_t hash;
+	uint32_t seq;
+	uint64_t key_off;
+	uint32_t key_len;
+	int32_t writer; // pid of the worker rendering this key, 0 if none
+	int64_t gave_up; // mtime of the source the last render only managed a degraded page of
+	int64_t gave_up_at; // when that render began
+	version v;
+} slot;
+
+// a range of the arena, and for a retired one the generation it was replaced in
+typedef struct extent {
+	uint64_t off;
+	uint64_t len;
+	uint64_t gen;
+} extent;
+
+// a worker process serving pages straight out of the arena. `pins` counts the pages it
+// holds, by the parity of the generation each was read in.
+typedef struct reader {
+	int32_t pid; // 0 if the entry is free
+	uint32_t pins[2];
+} reader;
+
+typedef struct region {
+	pthread_mutex_t lock; // held to claim slots, allocate and publish; never while rendering
+	uint32_t templates;
+	char full;            // the arena ran out, so new pages are not shared until some is freed
+	uint64_t used;        // everything past this was never allocated
+	uint64_t size;
+	uint64_t gen;         // advanced by the supervisor once no page of the one before is held
+	reader readers[SHARED_READERS];
+	uint32_t free_count;
+	extent free[SHARED_EXTENTS];       // sorted by offset, neighbours merged
+	uint32_t retired_count;
+	extent retired[SHARED_EXTENTS];    // replaced pages some reader may still be sending
+	slot slots[SHARED_SLOTS];
+} region;
+
+static region* shm = NULL;
+static size_t shm_len = 0;
+static time_t stale_window = 0;
+
+static char* arena() {
+	return (char*)(shm + 1);
+}
+
+// called locked. first fit among the freed ranges, then from the end never allocated.
+static int arena_alloc(size_t len, uint64_t* off) {
+	for (uint32_t i = 0; i < shm->free_count; i++) {
+		extent* e = &shm->free[i];
+		if (e->len < len)
+			continue;
+		*off = e->off;
+		e->off += len;
+		e->len -= len;
+		if (!e->len) {
+			memmove(e, e + 1, (shm->free_count - i - 1) * sizeof(*e));
+			shm->free_count--;
+		}
+		return 1;
+	}
+	if (shm->size - shm->used < len) {
+		__atomic_store_n(&shm->full, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	*off = shm->used;
+	shm->used += len;
+	return 1;
+}
+
+// called locked. returns 0 if the free list has no room for the range.
+static int arena_free(uint64_t off, uint64_t len) {
+	uint32_t i = 0;
+	extent* e;
+	while (i < shm->free_count && shm->free[i].off < off)
+		i++;
+	if (off + len == shm->used) {
+		// the end goes back to never allocated, along with a free range right before it
+		shm->used = off;
+		if (i && shm->free[i - 1].off + shm->free[i - 1].len == off) {
+			shm->used = shm->free[i - 1].off;
+			shm->free_count--;
+		}
+		return 1;
+	}
+	if (i && shm->free[i - 1].off + shm->free[i - 1].len == off) {
+		e = &shm->free[i - 1];
+		e->len += len;
+		if (i < shm->free_count && e->off + e->len == shm->free[i].off) {
+			e->len += shm->free[i].len;
+			memmove(&shm->free[i], &shm->free[i + 1], (shm->free_count - i - 1) * sizeof(*e));
+			shm->free_count--;
+		}
+		return 1;
+	}
+	if (i < shm->free_count && off + len == shm->free[i].off) {
+		shm->free[i].off = off;
+		shm->free[i].len += len;
+		return 1;
+	}
+	if (shm->free_count == SHARED_EXTENTS)
+		return 0;
+	e = &shm->free[i];
+	memmove(e + 1, e, (shm->free_count - i) * sizeof(*e));
+	e->off = off;
+	e->len = len;
+	shm->free_count++;
+	return 1;
+}
+
+static void lock() {
+#ifdef __linux__
+	if (pthread_mutex_lock(&shm->lock) == EOWNERDEAD) {
+		// a worker died holding the lock, possibly halfway through publishing a page
+		for (size_t i = 0; i < SHARED_SLOTS; i++) {
+			slot* s = &shm->slots[i];
+			if (s->seq & 1) {
+				s->v.present = 0;
+				__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+			}
+		}
+		pthread_mutex_consistent(&shm->lock);
+	}
+#else
+	pthread_mutex_lock(&shm->lock);
+#endif
+}
+
+static void unlock() {
+	pthread_mutex_unlock(&shm->lock);
+}
+
+static int64_t now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// sleeps for at most `ms` while `writer` is still rendering the slot
+static void wait_writer(slot* s, int32_t writer, int64_t ms) {
+#ifdef __linux__
+	// not FUTEX_PRIVATE_FLAG: the slot is shared with the other workers
+	struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+	syscall(SYS_futex, &s->writer, FUTEX_WAIT, writer, &ts, NULL, 0);
+#else
+	usleep(1000);
+#endif
+}
+
+// clears the slot's writer, waking everyone waiting for its render
+static void wake_writer(slot* s) {
+	__atomic_store_n(&s->writer, 0, __ATOMIC_RELEASE);
+#ifdef __linux__
+	syscall(SYS_futex, &s->writer, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+// the reader entry of this process, claimed on first use; NULL if all are taken
+static reader* self() {
+	static reader* me = NULL;
+	static int me_pid = 0;
+	int pid = getpid();
+	if (__atomic_load_n(&me_pid, __ATOMIC_ACQUIRE) == pid)
+		return me;
+	lock();
+	// forked workers start out with the entry of their parent, if any
+	if (me_pid != pid) {
+		me = NULL;
+		for (size_t i = 0; i < SHARED_READERS; i++) {
+			reader* r = &shm->readers[i];
+			if (!r->pid) {
+				memset(r, 0, sizeof(*r));
+				r->pid = pid;
+				me = r;
+				break;
+			}
+		}
+		__atomic_store_n(&me_pid, pid, __ATOMIC_RELEASE);
+	}
+	unlock();
+	return me;
+}
+
+// keeps whatever this process reads from the arena in place until the pin is released.
+// the generation is checked again once pinned, as the supervisor may have moved on
+// before the pin showed.
+static uint32_t* pin() {
+	reader* r = self();
+	if (!r)
+		return NULL;
+	for (;;) {
+		uint64_t gen = __atomic_load_n(&shm->gen, __ATOMIC_SEQ_CST);
+		uint32_t* p = &r->pins[gen & 1];
+		__atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&shm->gen, __ATOMIC_SEQ_CST) == gen)
+			return p;
+		__atomic_sub_fetch(p, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void unpin(uint32_t* pin) {
+	if (pin)
+		__atomic_sub_fetch(pin, 1, __ATOMIC_RELEASE);
+}
+
+// called locked. a replaced page is only freed once no reader can still be sending it.
+static int retire(const version* v) {
+	extent* e;
+	if (shm->retired_count == SHARED_EXTENTS)
+		return 0;
+	e = &shm->retired[shm->retired_count++];
+	e->off = v->head_off;
+	e->len = v->head_len + v->body_len;
+	e->gen = shm->gen;
+	return 1;
+}
+
+int shared_init(size_t bytes) {
+	pthread_mutexattr_t attr;
+	void* p;
+	if (shm)
+		return 1;
+	shm_len = sizeof(region) + bytes;
+	p = mmap(NULL, shm_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return 0;
+	shm = (region*)p; // anonymous mappings start zeroed, so every slot is free
+	shm->size = bytes;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+	pthread_mutex_init(&shm->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return 1;
+}
+
+void shared_set_stale_window(unsigned seconds) {
+	stale_window = seconds;
+}
+
+// returns the sequence number the version was read at
+static uint32_t read_version(slot* s, version* v) {
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(v, &s->v, sizeof(*v));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+				return seq;
+		}
+		sched_yield();
+	}
+}
+
+// called locked
+static void write_version(slot* s, const version* v) {
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->v = *v;
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+// linear probing. a slot is claimed, locked, by writing its key before publishing its hash.
+static slot* find(const char* key, size_t len, uint32_t hash, char create) {
+	for (size_t i = 0; i < SHARED_SLOTS; i++) {
+		slot* s = &shm->slots[(hash + i) & (SHARED_SLOTS - 1)];
+		uint32_t h = __atomic_load_n(&s->hash, __ATOMIC_ACQUIRE);
+		if (!h) {
+			uint64_t off;
+			if (!create || !arena_alloc(len, &off))
+				return NULL;
+			memcpy(arena() + off, key, len);
+			s->key_off = off;
+			s->key_len = (uint32_t)len;
+			__atomic_store_n(&s->hash, hash, __ATOMIC_RELEASE);
+			return s;
+		}
+		if (h == hash && s->key_len == len && !memcmp(arena() + s->key_off, key, len))
+			return s;
+	}
+	return NULL;
+}
+
+static char alive(int pid) {
+	return !kill(pid, 0) || errno != ESRCH;
+}
+
+// called locked. replacing a page takes room to retire it; without, the arena counts as full.
+static int can_replace(const version* old) {
+	if (!old->present || shm->retired_count < SHARED_EXTENTS)
+		return 1;
+	__atomic_store_n(&shm->full, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+// a render there was no room to publish, handed to the one request that asked for it
+static void copy_out(const buffer* head, const buffer* body, shared_page* out) {
+	char* p = malloc(head->len + body->len);
+	if (!p)
+		return;
+	memcpy(p, head->data, head->len);
+	memcpy(p + head->len, body->data, body->len);
+	out->head = p;
+	out->head_len = head->len;
+	out->data = p + head->len;
+	out->len = body->len;
+	out->pin = p;
+}
+
+// renders `key` and publishes it, giving up the claim on the slot either way. a degraded
+// page does not replace one already there, which is served on as if fresh instead, as in
+// the process-local cache. returns -1 if there is no such page, and 0 if the render could
+// not be published, in which case it is copied to `copy` where one is given.
+static int render_shared(slot* s, const char* key, const char* content_type, page_renderer render, shared_page* copy) {
+	buffer out = { 0 }, head = { 0 };
+	uint32_t tpl = __atomic_load_n(&shm->templates, __ATOMIC_RELAXED);
+	time_t mtime = 0;
+	time_t started = time(NULL);
+	version v, old;
+	int rendered = render(&out, key, &mtime);
+	int ok = rendered
+		&& http_head(&head, 200, "Hello there", content_type, out.len, hash_data(out.data, out.len));
+	int published = 0;
+
+	lock();
+	memset(&v, 0, sizeof(v));
+	old = s->v;
+	if (rendered < 0 && old.present) {
+		v = old;
+		v.stale = 0;
+		s->gave_up = mtime;
+		s->gave_up_at = started;
+		published = 1;
+	} else if (ok && can_replace(&old) && arena_alloc(head.len + out.len, &v.head_off)) {
+		v.head_len = head.len;
+		v.body_off = v.head_off + head.len;
+		v.body_len = out.len;
+		v.mtime = mtime;
+		v.rendered = started;
+		v.templates = tpl;
+		v.present = 1;
+		memcpy(arena() + v.head_off, head.data, head.len);
+		memcpy(arena() + v.body_off, out.data, out.len);
+		published = 1;
+		s->gave_up = 0;
+	}
+	// a failed render means the source is gone, so any stale page goes with it. with no
+	// room left to retire it, its range is lost to the arena.
+	if (published || !ok) {
+		write_version(s, &v);
+		if (old.present && old.head_off != v.head_off)
+			retire(&old);
+	}
+	unlock();
+	wake_writer(s);
+	if (ok && !published && copy)
+		copy_out(&head, &out, copy);
+	buffer_free(&out);
+	buffer_free(&head);
+	return rendered ? published : -1;
+}
+
+typedef struct render_job {
+	slot* s;
+	const char* content_type;
+	page_renderer render;
+	char key[];
+} render_job;
+
+static void render_main(void* udata) {
+	render_job* j = (render_job*)udata;
+	render_shared(j->s, j->key, j->content_type, j->render, NULL);
+	free(j);
+}
+
+// renders a claimed key on the I/O pool; returns 0 if there is no pool to take it
+static int render_later(slot* s, const char* key, size_t len, const char* content_type, page_renderer render) {
+	render_job* j = malloc(sizeof(*j) + len + 1);
+	if (!j)
+		return 0;
+	j->s = s;
+	j->content_type = content_type;
+	j->render = render;
+	memcpy(j->key, key, len + 1);
+	if (!io_run(render_main, j)) {
+		free(j);
+		return 0;
+	}
+	return 1;
+}
+
+static char within_stale_window(const version* v) {
+	return v->present && stale_window && time(NULL) - v->stale_since <= stale_window;
+}
+
+// single-flight across processes: the worker that claims a missing or stale key renders
+// it, the others wait for the result. within the stale window everyone, the claimer too,
+// keeps serving the stale page while it is rendered in the background.
+int shared_get(const char* key, const char* content_type, page_renderer render, shared_page* out) {
+	size_t len = strlen(key);
+	uint32_t hash = hash_string(key, len);
+	int pid = getpid();
+	int64_t deadline = 0;
+	slot* s;
+	if (!shm)
+		return 0;
+	out->pin = NULL;
+	if (!hash)
+		hash = 1;
+	s = find(key, len, hash, 0);
+	for (;;) {
+		version v;
+		uint32_t* p = NULL;
+		int32_t writer = 0;
+		int published;
+		char claimed = 0;
+		memset(&v, 0, sizeof(v));
+		if (s) {
+			if (!(p = pin()))
+				return 0;
+			read_version(s, &v);
+			if (v.present && !v.stale)
+				goto hit;
+		}
+		if (__atomic_load_n(&shm->full, __ATOMIC_RELAXED)) {
+			unpin(p);
+			return 0;
+		}
+		lock();
+		if (!s)
+			s = find(key, len, hash, 1);
+		if (s && (!s->writer || !alive(s->writer))) {
+			s->writer = pid;
+			claimed = 1;
+		} else if (s) {
+			writer = s->writer;
+		}
+		unlock();
+		if (!s)
+			return 0;
+		if (claimed) {
+			// a stale page goes out right away, and its replacement is rendered after it
+			if (within_stale_window(&v) && render_later(s, key, len, content_type, render))
+				goto hit;
+			unpin(p);
+			published = render_shared(s, key, content_type, render, out);
+			if (published < 0)
+				return -1;
+			if (!published)
+				return out->pin != NULL;
+			continue;
+		}
+		if (within_stale_window(&v))
+			goto hit;
+		unpin(p);
+		if (!deadline)
+			deadline = now_ms() + SHARED_WAIT_MS;
+		if (now_ms() >= deadline)
+			return 0;
+		wait_writer(s, writer, deadline - now_ms());
+		continue;
+	hit:
+		out->head = arena() + v.head_off;
+		out->head_len = (size_t)v.head_len;
+		out->data = arena() + v.body_off;
+		out->len = (size_t)v.body_len;
+		out->pin = p;
+		return 1;
+	}
+}
+
+// a stale page only counts while some worker is already rendering its replacement;
+// otherwise shared_get has to claim the render
+int shared_try_get(const char* key, shared_page* out) {
+	size_t len = strlen(key);
+	uint32_t hash = hash_string(key, len);
+	version v;
+	uint32_t* p;
+	slot* s;
+	if (!shm)
+		return 0;
+	s = find(key, len, hash ? hash : 1, 0);
+	if (!s || !(p = pin()))
+		return 0;
+	read_version(s, &v);
+	if (!v.present || (v.stale && !(stale_window && __atomic_load_n(&s->writer, __ATOMIC_ACQUIRE)
+		&& time(NULL) - v.stale_since <= stale_window))) {
+		unpin(p);
+		return 0;
+	}
+	out->head = arena() + v.head_off;
+	out->head_len = (size_t)v.head_len;
+	out->data = arena() + v.body_off;
+	out->len = (size_t)v.body_len;
+	out->pin = p;
+	return 1;
+}
+
+// a pin points into the region, anything else is a copy_out
+void shared_release(void* pin) {
+	if ((char*)pin >= (char*)shm && (char*)pin < (char*)shm + shm_len)
+		unpin((uint32_t*)pin);
+	else
+		free(pin);
+}
+
+// marks pages whose source or templates changed since they were rendered. the sources are
+// looked at without the lock, which every worker needs to claim and publish: keys never
+// change once a slot has its hash, and versions are read like any reader does. the lock
+// is only taken to mark a version, and only if no other one was published meanwhile.
+void shared_revalidate(page_source source, uint32_t templates) {
+	time_t now = time(NULL);
+	if (!shm)
+		return;
+	__atomic_store_n(&shm->templates, templates, __ATOMIC_RELAXED);
+	for (size_t i = 0; i < SHARED_SLOTS; i++) {
+		slot* s = &shm->slots[i];
+		char key[1024];
+		version v;
+		uint32_t seq;
+		time_t mtime;
+		if (!__atomic_load_n(&s->hash, __ATOMIC_ACQUIRE) || s->key_len >= sizeof(key))
+			continue;
+		seq = read_version(s, &v);
+		if (!v.present || v.stale)
+			continue;
+		memcpy(key, arena() + s->key_off, s->key_len);
+		key[s->key_len] = '\0';
+		mtime = source(key);
+		if (v.templates == templates && source_unchanged(mtime, (time_t)v.mtime, (time_t)v.rendered, now))
+			continue;
+		lock();
+		// a kept page is only left be while it has the current templates
+		if (s->seq == seq && !(s->gave_up && v.templates == templates
+			&& source_unchanged(mtime, (time_t)s->gave_up, (time_t)s->gave_up_at, now))) {
+			v.stale = 1;
+			v.stale_since = now;
+			write_version(s, &v);
+		}
+		unlock();
+	}
+}
+
+// advances the generation once no reader holds a page of the one before, and frees
+// the pages replaced before that: whoever read them pinned a generation now over
+void shared_collect() {
+	uint64_t gen;
+	uint32_t kept = 0;
+	char freed = 0;
+	if (!shm)
+		return;
+	lock();
+	gen = shm->gen;
+	for (size_t i = 0; i < SHARED_READERS; i++) {
+		if (__atomic_load_n(&shm->readers[i].pins[(gen + 1) & 1], __ATOMIC_SEQ_CST)) {
+			unlock();
+			return;
+		}
+	}
+	__atomic_store_n(&shm->gen, gen + 1, __ATOMIC_SEQ_CST);
+	for (uint32_t i = 0; i < shm->retired_count; i++) {
+		extent* e = &shm->retired[i];
+		if (e->gen < gen && arena_free(e->off, e->len))
+			freed = 1;
+		else
+			shm->retired[kept++] = *e;
+	}
+	shm->retired_count = kept;
+	if (freed)
+		__atomic_store_n(&shm->full, 0, __ATOMIC_RELAXED);
+	unlock();
+}
+
+// a dead worker's pins go with it, as do the pages it was sending
+void shared_forget(int pid) {
+	if (!shm)
+		return;
+	lock();
+	for (size_t i = 0; i < SHARED_SLOTS; i++) {
+		if (shm->slots[i].writer == pid)
+			wake_writer(&shm->slots[i]);
+	}
+	for (size_t i = 0; i < SHARED_READERS; i++) {
+		if (shm->readers[i].pid == pid)
+			memset(&shm->readers[i], 0, sizeof(shm->readers[i]));
+	}
+	unlock();
+}
+
+void shared_free() {
+	if (!shm)
+		return;
+	pthread_mutex_destroy(&shm->lock);
+	munmap(shm, shm_len);
+	shm = NULL;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include "cache.h"
+
+// page cache shared by forked worker processes. pages are kept in an arena in shared
+// memory and read without locks; each key is rendered by one worker at a time and the
+// result is published to all of them. a page found stays in place until it is released,
+// and the space of replaced pages is reused once none is held anymore.
+typedef struct shared_page {
+	const char* head;
+	size_t head_len;
+	const char* data;
+	size_t len;
+	void* pin; // passed to shared_release once the page is sent
+} shared_page;
+
+// maps `bytes` of arena before forking; returns 0 where shared memory is not available
+int shared_init(size_t bytes);
+void shared_set_stale_window(unsigned seconds);
+// returns 0 if the page could not be served from shared memory, leaving it to the local cache,
+// and -1 if there is no such page
+int shared_get(const char* key, const char* content_type, page_renderer render, shared_page* out);
+// like shared_get, but returns 0 rather than rendering or waiting for a render
+int shared_try_get(const char* key, shared_page* out);
+void shared_release(void* pin);
+void shared_revalidate(page_source source, uint32_t templates);
+// frees the space of replaced pages no worker can still be sending; called by the supervisor
+void shared_collect();
+// gives up the renders a dead worker had claimed
+void shared_forget(int pid);
+void shared_free();
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include "thread.h"
+
+#include "debugalloc.h"
+
+typedef struct thread_start_info {
+	thread_fn fn;
+	void* arg;
+} thread_start_info;
+
+#ifdef _WIN32
+
+void mutex_init(mutex* m) { InitializeSRWLock(m); }
+void mutex_lock(mutex* m) { AcquireSRWLockExclusive(m); }
+void mutex_unlock(mutex* m) { ReleaseSRWLockExclusive(m); }
+void mutex_destroy(mutex* m) { (void)m; }
+
+void cond_init(cond_var* c) { InitializeConditionVariable(c); }
+void cond_wait(cond_var* c, mutex* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+void cond_broadcast(cond_var* c) { WakeAllConditionVariable(c); }
+void cond_destroy(cond_var* c) { (void)c; }
+
+static DWORD WINAPI thread_main(LPVOID param) {
+	thread_start_info info = *(thread_start_info*)param;
+	free(param);
+	info.fn(info.arg);
+	return 0;
+}
+
+int thread_spawn(thread_fn fn, void* arg) {
+	HANDLE t;
+	thread_start_info* info = malloc(sizeof(*info));
+	if (!info)
+		return 0;
+	info->fn = fn;
+	info->arg = arg;
+	t = CreateThread(NULL, 0, thread_main, info, 0, NULL);
+	if (!t) {
+		free(info);
+		return 0;
+	}
+	CloseHandle(t);
+	return 1;
+}
+
+#else
+
+void mutex_init(mutex* m) { pthread_mutex_init(m, NULL); }
+void mutex_lock(mutex* m) { pthread_mutex_lock(m); }
+void mutex_unlock(mutex* m) { pthread_mutex_unlock(m); }
+void mutex_destroy(mutex* m) { pthread_mutex_destroy(m); }
+
+void cond_init(cond_var* c) { pthread_cond_init(c, NULL); }
+void cond_wait(cond_var* c, mutex* m) { pthread_cond_wait(c, m); }
+void cond_broadcast(cond_var* c) { pthread_cond_broadcast(c); }
+void cond_destroy(cond_var* c) { pthread_cond_destroy(c); }
+
+static void* thread_main(void* param) {
+	thread_start_info info = *(thread_start_info*)param;
+	free(param);
+	info.fn(info.arg);
+	return NULL;
+}
+
+int thread_spawn(thread_fn fn, void* arg) {
+	pthread_t t;
+	thread_start_info* info = malloc(sizeof(*info));
+	if (!info)
+		return 0;
+	info->fn = fn;
+	info->arg = arg;
+	if (pthread_create(&t, NULL, thread_main, info)) {
+		free(info);
+		return 0;
+	}
+	pthread_detach(t);
+	return 1;
+}
+
+#endif
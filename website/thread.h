@@ -0,0 +1,53 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+typedef SRWLOCK mutex;
+typedef CONDITION_VARIABLE cond_var;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t mutex;
+typedef pthread_cond_t cond_var;
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+typedef void (*thread_fn)(void* arg);
+
+void mutex_init(mutex* m);
+void mutex_lock(mutex* m);
+void mutex_unlock(mutex* m);
+void mutex_destroy(mutex* m);
+
+void cond_init(cond_var* c);
+void cond_wait(cond_var* c, mutex* m);
+void cond_broadcast(cond_var* c);
+void cond_destroy(cond_var* c);
+
+int thread_spawn(thread_fn fn, void* arg); // detached
+
+// loads acquire, stores release, read-modify-writes and atomic_fence are sequentially consistent
+#ifdef _WIN32
+static __inline void* atomic_load_ptr(void* volatile* p) { void* v = *p; _ReadWriteBarrier(); return v; }
+static __inline void atomic_store_ptr(void* volatile* p, void* v) { InterlockedExchangePointer(p, v); }
+static __inline int atomic_load_int(volatile int* p) { int v = *p; _ReadWriteBarrier(); return v; }
+static __inline void atomic_store_int(volatile int* p, int v) { InterlockedExchange((volatile LONG*)p, v); }
+static __inline int atomic_inc(volatile int* p) { return InterlockedIncrement((volatile LONG*)p); }
+static __inline int atomic_dec(volatile int* p) { return InterlockedDecrement((volatile LONG*)p); }
+static __inline void atomic_fence() { MemoryBarrier(); }
+#else
+static inline void* atomic_load_ptr(void* volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void atomic_store_ptr(void* volatile* p, void* v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline int atomic_load_int(volatile int* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void atomic_store_int(volatile int* p, int v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline int atomic_inc(volatile int* p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+static inline int atomic_dec(volatile int* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+static inline void atomic_fence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
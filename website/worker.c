@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "worker.h"
+#include "affinity.h"
+#include "html.h"
+#include "thread.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "debugalloc.h"
+
+// a burst is handed out in full before the listener's select is consulted again
+#define WORKER_ACCEPT_BATCH 64
+// open connections a worker may be ahead of the others and still get the ones its cpu received
+#define WORKER_LOCAL_SLACK 16
+
+typedef struct worker {
+	sb_Server* srv;
+	int cpu;  // pinned to, -1 if not
+	int node;
+	char failed;
+	// written by the accepting thread and the worker, read by anyone serving the stats
+	volatile int connections;
+	volatile int same_cpu;  // connections whose packets arrived on this worker's cpu
+	volatile int same_node; // ... or at least on its node
+	volatile int running_on;
+} worker;
+
+static worker** workers = NULL;
+static int worker_count = 0;
+static int next_worker = 0;
+static worker_policy policy = WORKER_ROUND_ROBIN;
+static volatile sig_atomic_t* running = NULL;
+static const sb_Options* options = NULL;
+static const int* cpus = NULL;
+static int cpu_count = 0;
+static int cpu_offset = 0;
+static char spread = 0; // the workers sit on more than one node
+static signed char nodes[AFFINITY_MAX_CPUS]; // node of each cpu as looked up by the accepting thread, -2 if not yet
+static mutex lock;
+static cond_var changed;
+static int starting = 0;
+static int active = 0;
+
+// the worker pins itself before creating its server, so the server and every stream it
+// opens are first touched, and so placed, on its own node
+static void worker_main(void* arg) {
+	worker* w = (worker*)arg;
+	sb_Server* srv;
+	if (w->cpu != -1 && !affinity_pin(w->cpu)) {
+		fprintf(stderr, "failed to pin a worker thread to cpu %d\n", w->cpu);
+		w->cpu = -1;
+	}
+	srv = w->srv = sb_new_worker(options);
+	mutex_lock(&lock);
+	starting--;
+	if (!srv) {
+		w->failed = 1;
+		active--;
+	}
+	cond_broadcast(&changed);
+	mutex_unlock(&lock);
+	if (!srv)
+		return;
+	html_thread_start();
+	while (*running) {
+		atomic_store_int(&w->running_on, affinity_cpu());
+		sb_poll_server(srv, 1000);
+	}
+	html_thread_stop();
+	mutex_lock(&lock);
+	active--;
+	cond_broadcast(&changed);
+	mutex_unlock(&lock);
+}
+
+void worker_set_cpus(const int* list, int count, int offset) {
+	cpus = list;
+	cpu_count = count;
+	cpu_offset = offset;
+}
+
+int worker_start(int count, const sb_Options* opt, worker_policy p, volatile sig_atomic_t* r) {
+	int spawned = 0;
+	workers = calloc(count, sizeof(*workers));
+	if (!workers)
+		return 0;
+	policy = p;
+	running = r;
+	options = opt;
+	memset(nodes, -2, sizeof(nodes));
+	mutex_init(&lock);
+	cond_init(&changed);
+	for (int i = 0; i < count; i++) {
+		worker* w = workers[i] = calloc(1, sizeof(*w));
+		if (!w)
+			break;
+		w->cpu = cpu_count ? cpus[(cpu_offset + i) % cpu_count] : -1;
+		w->node = w->cpu != -1 ? affinity_node(w->cpu) : -1;
+		w->running_on = -1;
+		if (w->node != workers[0]->node)
+			spread = 1;
+		mutex_lock(&lock);
+		starting++;
+		active++;
+		mutex_unlock(&lock);
+		if (!thread_spawn(worker_main, w)) {
+			mutex_lock(&lock);
+			starting--;
+			active--;
+			mutex_unlock(&lock);
+			free(w);
+			workers[i] = NULL;
+			break;
+		}
+		spawned++;
+	}
+	mutex_lock(&lock);
+	while (starting)
+		cond_wait(&changed, &lock);
+	mutex_unlock(&lock);
+	// workers that failed to start are dropped, keeping the ones that did
+	for (int i = 0; i < spawned; i++) {
+		if (workers[i]->failed)
+			free(workers[i]);
+		else
+			workers[worker_count++] = workers[i];
+	}
+	if (!worker_count) {
+		free(workers);
+		workers = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static worker* pick() {
+	worker* best;
+	if (policy == WORKER_ROUND_ROBIN) {
+		best = workers[next_worker];
+		next_worker = (next_worker + 1) % worker_count;
+		return best;
+	}
+	// ties go round-robin too, so an idle pool still spreads connections out
+	best = workers[next_worker];
+	for (int i = 1; i < worker_count; i++) {
+		worker* w = workers[(next_worker + i) % worker_count];
+		if (sb_load(w->srv) < sb_load(best->srv))
+			best = w;
+	}
+	next_worker = (next_worker + 1) % worker_count;
+	return best;
+}
+
+static int node_of(int cpu) {
+	if (cpu < 0 || cpu >= AFFINITY_MAX_CPUS)
+		return -1;
+	if (nodes[cpu] == -2)
+		nodes[cpu] = (signed char)affinity_node(cpu);
+	return nodes[cpu];
+}
+
+// a connection goes to the worker pinned to the cpu its packets arrive on, or failing that one
+// on the same node, unless that would leave the pool unbalanced
+static worker* pick_local(int cpu) {
+	worker* any = pick();
+	worker* local = NULL;
+	int node = node_of(cpu);
+	for (int i = 0; i < worker_count && !local; i++) {
+		if (workers[i]->cpu == cpu)
+			local = workers[i];
+	}
+	if (!local && spread && node != -1) {
+		for (int i = 0; i < worker_count; i++) {
+			worker* w = workers[i];
+			if (w->node == node && (!local || sb_load(w->srv) < sb_load(local->srv)))
+				local = w;
+		}
+	}
+	if (local && sb_load(local->srv) <= sb_load(any->srv) + WORKER_LOCAL_SLACK)
+		return local;
+	return any;
+}
+
+// with no room, sb_accept only waits a moment for some to free up
+void worker_accept(sb_Server* listener, int timeout, int room) {
+	sb_set_accepting(listener, room > 0);
+	for (int i = 0; i < WORKER_ACCEPT_BATCH && (i < room || !i); i++) {
+		int sockfd = sb_accept(listener, i ? 0 : timeout);
+		int cpu;
+		worker* w;
+		if (sockfd == -1)
+			return;
+		cpu = cpu_count ? affinity_incoming_cpu(sockfd) : -1;
+		w = cpu != -1 ? pick_local(cpu) : pick();
+		if (sb_hand_off(w->srv, sockfd)) {
+#ifdef _WIN32
+			closesocket(sockfd);
+#else
+			close(sockfd);
+#endif
+			continue;
+		}
+		atomic_inc(&w->connections);
+		if (cpu != -1 && cpu == w->cpu)
+			atomic_inc(&w->same_cpu);
+		if (cpu != -1 && w->node != -1 && node_of(cpu) == w->node)
+			atomic_inc(&w->same_node);
+	}
+}
+
+int worker_stats(buffer* b) {
+	char line[256];
+	for (int i = 0; i < worker_count; i++) {
+		worker* w = workers[i];
+		int on = atomic_load_int(&w->running_on);
+		sprintf(line, "worker %d cpu %d node %d running-on %d running-on-node %d open %d connections %d same-cpu %d same-node %d\n",
+			i, w->cpu, w->node, on, on != -1 ? affinity_node(on) : -1, sb_load(w->srv),
+			atomic_load_int(&w->connections), atomic_load_int(&w->same_cpu), atomic_load_int(&w->same_node));
+		if (!buffer_append_str(b, line))
+			return 0;
+	}
+	return 1;
+}
+
+size_t worker_pending() {
+	size_t n = 0;
+	for (int i = 0; i < worker_count; i++)
+		n += sb_pending(workers[i]->srv);
+	return n;
+}
+
+void worker_stop() {
+	if (!workers)
+		return;
+	mutex_lock(&lock);
+	while (active)
+		cond_wait(&changed, &lock);
+	mutex_unlock(&lock);
+	for (int i = 0; i < worker_count; i++) {
+		sb_close_server(workers[i]->srv);
+		free(workers[i]);
+	}
+	free(workers);
+	workers = NULL;
+	worker_count = 0;
+	cond_destroy(&changed);
+	mutex_destroy(&lock);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <signal.h>
+#include "sandbird/sandbird.h"
+#include "buffer.h"
+
+// how the accepting thread picks a worker for each new connection
+typedef enum worker_policy {
+	WORKER_ROUND_ROBIN,
+	WORKER_LEAST_LOADED
+} worker_policy;
+
+// pins worker `i` to cpus[(offset + i) % count]; call before worker_start
+void worker_set_cpus(const int* cpus, int count, int offset);
+// starts `count` threads, each polling its own sandbird worker until `running` is cleared
+int worker_start(int count, const sb_Options* opt, worker_policy policy, volatile sig_atomic_t* running);
+// accepts up to `room` connections on `listener` for up to `timeout` milliseconds,
+// handing each to a worker
+void worker_accept(sb_Server* listener, int timeout, int room);
+// appends a line per worker: where it is pinned, where it runs, and how many of its
+// connections arrived on its own cpu and node
+int worker_stats(buffer* b);
+// output the workers have queued but not yet sent
+size_t worker_pending();
+// waits for every worker to finish and closes their servers
+void worker_stop();